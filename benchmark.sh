@@ -0,0 +1,331 @@
+#!/bin/bash
+
+#############################################
+# Banc d'essai du segmenteur
+# N passes sur une vidéo : débit et compteurs matériels
+# Mode "scaling" : montée en charge du traitement par lot
+# Mode "sinks" : comparaison des modes de sortie
+#############################################
+
+# Usage: ./benchmark.sh [video.mp4] [passes] [options du segmenteur...]
+#        ./benchmark.sh scaling [video.mp4|synthetic] [jobs_max] [copies] [rapport.json]
+#        ./benchmark.sh sinks [video.mp4] [latence_ms] [rapport.json]
+
+# Efficacité (débit / (jobs x débit à 1 job)) sous laquelle la montée sature
+SATURATION_EFFICIENCY=70
+
+# Montée en charge : le même corpus passe par le vrai chemin des jobs
+# (process_videos_parallel de video_processor.sh, admission et placement
+# compris) à 1, 2, 4... jobs simultanés. Le palier à 1 job prend le même chemin
+# que les autres : le chemin séquentiel fausserait la référence de l'efficacité. Pour chaque palier : débit agrégé, latence par
+# job, efficacité, occupation CPU et iowait ; le premier palier sous
+# SATURATION_EFFICIENCY % est le point de saturation, attribué aux E/S (iowait),
+# au CPU (occupé) ou sinon à la contention (verrous, sérialisation).
+scaling_benchmark() {
+    local input="${1:-synthetic}"
+    local max_jobs="${2:-$(nproc 2>/dev/null || echo 1)}"
+    local copies="${3:-$((max_jobs * 2))}"
+    local report="${4:-scaling_report.json}"
+
+    # fonctions et configuration du script de production
+    source ./video_processor.sh
+    if [ ! -x "$SEGMENTER" ]; then
+        echo "Le binaire $SEGMENTER n'existe pas ou n'est pas exécutable" >&2
+        return 1
+    fi
+
+    # global : le trap EXIT s'exécute hors de la fonction
+    bench_dir=$(mktemp -d "${TMPDIR:-/tmp}/segmenter_scaling.XXXXXX") || return 1
+    trap 'rm -rf "$bench_dir"' EXIT
+
+    local master="$bench_dir/master.mp4"
+    if [ "$input" = "synthetic" ]; then
+        if ! ffmpeg -v error -f lavfi -i testsrc2=size=1280x720:rate=25 -f lavfi -i sine=frequency=440 \
+            -t 60 -c:v libx264 -preset veryfast -g 50 -c:a aac -shortest "$master"; then
+            echo "Impossible de générer le corpus synthétique (ffmpeg)" >&2
+            return 1
+        fi
+    elif [ -f "$input" ]; then
+        cp "$input" "$master"
+    else
+        echo "Vidéo introuvable: $input" >&2
+        return 1
+    fi
+
+    WATCH_DIR="$bench_dir/watch"
+    OUTPUT_DIR="$bench_dir/streams"
+    PROCESSING_DIR="$bench_dir/processing"
+    DONE_DIR="$bench_dir/done"
+    ERROR_DIR="$bench_dir/error"
+    LOG_FILE="$bench_dir/processor.log"
+    LOCK_FILE="$bench_dir/processor.lock"
+    BUDGET_FILE="$bench_dir/budget"
+    SEGMENTER_PIDS="$bench_dir/pids"
+    JOB_STATS_FILE="$bench_dir/jobs.stats"
+    init_directories
+
+    local -a levels=()
+    local jobs
+    for ((jobs = 1; jobs < max_jobs; jobs *= 2)); do levels+=("$jobs"); done
+    levels+=("$max_jobs")
+
+    local size
+    size=$(file_size "$master")
+    echo "=== Montée en charge: $input ($((size / 1048576)) Mo), $copies copies, paliers ${levels[*]} ==="
+    echo "Date: $(date '+%Y-%m-%d %H:%M:%S') | $(uname -sr) | $(nproc 2>/dev/null || echo '?') CPU"
+    echo ""
+    printf "%5s %9s %9s %9s %9s %7s %6s %8s %9s %6s\n" \
+        jobs "Mo/s" "lat moy" "lat p50" "lat max" "effic." "CPU%" "iowait%" "coeur/job" "échecs"
+
+    local base_rate="" saturation="null" levels_json=""
+    for jobs in "${levels[@]}"; do
+        rm -rf "${WATCH_DIR:?}"/*.mp4 "${OUTPUT_DIR:?}"/* "${DONE_DIR:?}"/* "${ERROR_DIR:?}"/*
+        : > "$JOB_STATS_FILE"
+        local i
+        for ((i = 1; i <= copies; i++)); do
+            cp "$master" "$WATCH_DIR/bench_$i.mp4"
+        done
+        sync
+
+        # contrôleur adaptatif figé sur le palier
+        MAX_JOBS=$jobs
+        MIN_JOBS=$jobs
+        CURRENT_JOBS=$jobs
+
+        local -a corpus=("$WATCH_DIR"/bench_*.mp4)
+        local cpu_start started elapsed cpu_delta
+        cpu_start=$(cpu_snapshot)
+        started=$(now_seconds)
+        process_videos_parallel "${corpus[@]}" > /dev/null
+        elapsed=$(awk -v a="$started" -v b="$(now_seconds)" 'BEGIN { print b - a }')
+        cpu_delta=$(awk -v a="$cpu_start" -v b="$(cpu_snapshot)" 'BEGIN { split(a, x, " "); split(b, y, " "); print y[1] - x[1], y[2] - x[2], y[3] - x[3] }')
+
+        local line
+        line=$(sort -k3 -n "$JOB_STATS_FILE" | awk -v secs="$elapsed" -v jobs="$jobs" -v base="$base_rate" \
+                   -v cpu="$cpu_delta" -v sat="$SATURATION_EFFICIENCY" '
+            { status[NR] = $1; bytes += $2; wall[NR] = $3; total_wall += $3; total_cpu += $4; if ($1 != 0) failed++ }
+            END {
+                n = NR
+                rate = bytes / 1048576 / secs
+                split(cpu, c, " ")
+                busy = c[2] > 0 ? 100 * c[1] / c[2] : 0
+                iow = c[2] > 0 ? 100 * c[3] / c[2] : 0
+                if (base == "") base = rate
+                eff = base > 0 ? 100 * rate / (jobs * base) : 0
+                cause = ""
+                if (jobs > 1 && eff < sat) cause = iow >= 20 ? "E/S" : (busy >= 90 ? "CPU" : "contention")
+                avg = n ? total_wall / n : 0
+                p50 = n ? wall[int((n + 1) / 2)] : 0
+                per_job = total_wall > 0 ? total_cpu / total_wall : 0
+                printf "%d %.2f %.3f %.3f %.3f %.1f %.0f %.0f %.2f %d %.2f %s\n", jobs, rate,
+                       avg, p50, wall[n] + 0, eff, busy, iow, per_job, failed + 0, rate, cause
+            }')
+
+        local l_jobs rate lat_avg lat_p50 lat_max eff busy iow per_job failed raw cause
+        read -r l_jobs rate lat_avg lat_p50 lat_max eff busy iow per_job failed raw cause <<< "$line"
+        [ -z "$base_rate" ] && base_rate=$raw
+        printf "%5d %9s %8ss %8ss %8ss %6s%% %6s %8s %9s %6s%s\n" "$l_jobs" "$rate" "$lat_avg" "$lat_p50" "$lat_max" \
+            "$eff" "$busy" "$iow" "$per_job" "$failed" "${cause:+  <- saturation ($cause)}"
+
+        if [ -n "$cause" ] && [ "$saturation" = "null" ]; then
+            saturation="{\"jobs\": $l_jobs, \"cause\": \"$cause\"}"
+        fi
+        levels_json+="${levels_json:+,}
+    {\"jobs\": $l_jobs, \"mb_s\": $rate, \"latency_avg_s\": $lat_avg, \"latency_p50_s\": $lat_p50, \"latency_max_s\": $lat_max, \"efficiency_pct\": $eff, \"cpu_busy_pct\": $busy, \"iowait_pct\": $iow, \"cpu_per_job\": $per_job, \"failed\": $failed}"
+    done
+
+    cat > "$report" <<EOF
+{
+  "input": "$input",
+  "input_bytes": $size,
+  "copies": $copies,
+  "cpus": $(nproc 2>/dev/null || echo 0),
+  "saturation_efficiency_pct": $SATURATION_EFFICIENCY,
+  "levels": [$levels_json
+  ],
+  "saturation": $saturation
+}
+EOF
+    echo ""
+    echo "Rapport JSON: $report"
+}
+
+# Modes de sortie : la même vidéo passe par chaque sortie disponible, sur le
+# système de fichiers local. Pour chacune : write syscalls, octets écrits,
+# fichiers créés, distribution de la latence de fermeture des segments
+# ([Fermeture] du segmenteur) et temps total. latence_ms > 0 simule un disque
+# lent (--inject-write-latency-ms). Le staging tmpfs écrit dans /dev/shm puis
+# déplace les segments vers le disque ; ce déplacement compte dans le temps total.
+# Le segmenteur ne sait produire que des fichiers TS : plage d'octets dans un
+# fichier unique, fMP4 et io_uring figurent au rapport comme indisponibles.
+sinks_benchmark() {
+    local input="${1:-video.mp4}"
+    local latency="${2:-0}"
+    local report="${3:-sinks_report.json}"
+    local segmenter="./usr/local/bin/video_segmenter"
+    local segment_duration=10
+
+    if [ ! -x "$segmenter" ]; then
+        echo "Le binaire $segmenter n'existe pas ou n'est pas exécutable" >&2
+        return 1
+    fi
+    if [ ! -f "$input" ]; then
+        echo "Vidéo introuvable: $input" >&2
+        return 1
+    fi
+
+    # global : le trap EXIT s'exécute hors de la fonction
+    bench_dir=$(mktemp -d "${TMPDIR:-/tmp}/segmenter_sinks.XXXXXX") || return 1
+    stage_dir=""
+    trap 'rm -rf "$bench_dir" ${stage_dir:+"$stage_dir"}' EXIT
+    if [ -d /dev/shm ] && [ -w /dev/shm ]; then
+        stage_dir=$(mktemp -d /dev/shm/segmenter_stage.XXXXXX) || stage_dir=""
+    fi
+
+    # nom|options du segmenteur
+    local -a sinks=(
+        "ts-direct|"
+        "ts-petit-buffer|--avio-buffer-size=32768 --write-coalesce-bytes=32768"
+        "ts-write-behind|--write-behind=67108864 --writer-threads=2"
+        "ts-tmpfs|"
+    )
+    local -a unavailable=(byte-range fmp4 io_uring)
+    local -a inject=()
+    [ "$latency" -gt 0 ] && inject=(--inject-write-latency-ms="$latency")
+
+    echo "=== Modes de sortie: $input, latence injectée ${latency} ms ==="
+    echo "Date: $(date '+%Y-%m-%d %H:%M:%S') | $(uname -sr) | $(df -PT "$bench_dir" | awk 'NR == 2 { print $2 }') sous $bench_dir"
+    echo ""
+
+    # première passe pour le cache de pages, non comptée
+    "$segmenter" "$input" "$bench_dir" "$bench_dir/warm.m3u8" segment .ts $segment_duration 0 > /dev/null 2>&1
+    rm -rf "${bench_dir:?}"/*
+
+    printf "%-16s %9s %10s %8s %8s %8s %8s %8s %9s\n" \
+        sortie syscalls "octets" fichiers "p50 ms" "p90 ms" "p99 ms" "max ms" "total s"
+
+    local sinks_json="" entry name opts
+    for entry in "${sinks[@]}"; do
+        name=${entry%%|*}
+        opts=${entry#*|}
+        local target="$bench_dir/$name" work="$bench_dir/$name"
+        if [ "$name" = "ts-tmpfs" ]; then
+            if [ -z "$stage_dir" ]; then
+                printf "%-16s %s\n" "$name" "indisponible (/dev/shm non inscriptible)"
+                sinks_json+="${sinks_json:+,}
+    {\"sink\": \"$name\", \"available\": false}"
+                continue
+            fi
+            work="$stage_dir"
+        fi
+        mkdir -p "$target"
+
+        local started output elapsed
+        started=$(date +%s.%N)
+        # options volontairement découpées en mots
+        # shellcheck disable=SC2086
+        if ! output=$("$segmenter" "$input" "$work" "$work/index.m3u8" segment .ts $segment_duration 0 \
+                $opts "${inject[@]}" 2>&1); then
+            echo "Échec de la sortie $name" >&2
+            printf '%s\n' "$output" | tail -n 5 >&2
+            return 1
+        fi
+        if [ "$work" != "$target" ]; then
+            mv "$work"/* "$target"/ && sync
+        fi
+        elapsed=$(awk -v a="$started" -v b="$(date +%s.%N)" 'BEGIN { printf "%.3f", b - a }')
+
+        local files line
+        files=$(find "$target" -type f | wc -l)
+        line=$(printf '%s\n' "$output" | awk '
+            /^\[Sortie\]/ { syscalls = $2 }
+            /^\[Fermeture\] [0-9]/ { bytes = $4; p50 = $9; p90 = $11; p99 = $13; max = $15 }
+            END { printf "%d %d %.2f %.2f %.2f %.2f\n", syscalls, bytes, p50, p90, p99, max }')
+        local syscalls bytes p50 p90 p99 max
+        read -r syscalls bytes p50 p90 p99 max <<< "$line"
+        # "[Fermeture] histogramme ms <=1:3 ... >1000:0" -> {"<=1": 3, ...}
+        local histogram
+        histogram=$(printf '%s\n' "$output" | awk '
+            /^\[Fermeture\] histogramme/ {
+                for (i = 4; i <= NF; i++) {
+                    split($i, kv, ":")
+                    out = out (out == "" ? "" : ", ") "\"" kv[1] "\": " kv[2]
+                }
+            }
+            END { print "{" out "}" }')
+
+        printf "%-16s %9d %10d %8d %8s %8s %8s %8s %9s\n" \
+            "$name" "$syscalls" "$bytes" "$files" "$p50" "$p90" "$p99" "$max" "$elapsed"
+        printf '%s\n' "$output" | sed -n 's/^\[Fermeture\] histogramme ms/                 fermetures (ms)/p'
+        sinks_json+="${sinks_json:+,}
+    {\"sink\": \"$name\", \"available\": true, \"options\": \"$opts\", \"write_syscalls\": $syscalls, \"bytes_written\": $bytes, \"files_created\": $files, \"close_latency_ms\": {\"p50\": $p50, \"p90\": $p90, \"p99\": $p99, \"max\": $max}, \"close_histogram_ms\": $histogram, \"wall_s\": $elapsed}"
+        rm -rf "${target:?}"
+    done
+
+    for name in "${unavailable[@]}"; do
+        printf "%-16s %s\n" "$name" "indisponible (sortie non implémentée)"
+        sinks_json+="${sinks_json:+,}
+    {\"sink\": \"$name\", \"available\": false}"
+    done
+
+    cat > "$report" <<EOF
+{
+  "input": "$input",
+  "input_bytes": $(stat -c %s "$input" 2>/dev/null || stat -f %z "$input"),
+  "injected_write_latency_ms": $latency,
+  "sinks": [$sinks_json
+  ]
+}
+EOF
+    echo ""
+    echo "Rapport JSON: $report"
+}
+
+if [ "${1:-}" = "scaling" ]; then
+    shift
+    scaling_benchmark "$@"
+    exit $?
+fi
+if [ "${1:-}" = "sinks" ]; then
+    shift
+    sinks_benchmark "$@"
+    exit $?
+fi
+INPUT="${1:-video.mp4}"
+RUNS="${2:-3}"
+shift $(( $# < 2 ? $# : 2 ))
+EXTRA_OPTS=("$@")
+
+set -o pipefail
+
+SEGMENTER="./usr/local/bin/video_segmenter"
+SEGMENT_DURATION=10
+
+if [ ! -x "$SEGMENTER" ]; then
+    echo "Le binaire $SEGMENTER n'existe pas ou n'est pas exécutable" >&2
+    exit 1
+fi
+if [ ! -f "$INPUT" ]; then
+    echo "Vidéo introuvable: $INPUT" >&2
+    exit 1
+fi
+
+OUT_DIR=$(mktemp -d "${TMPDIR:-/tmp}/segmenter_bench.XXXXXX")
+trap 'rm -rf "$OUT_DIR"' EXIT
+
+echo "=== Banc d'essai: $INPUT, $RUNS passes ${EXTRA_OPTS[*]} ==="
+echo "Date: $(date '+%Y-%m-%d %H:%M:%S') | $(uname -sr) | $(nproc 2>/dev/null || sysctl -n hw.ncpu) CPU"
+
+# première passe pour le cache de pages, non comptée
+"$SEGMENTER" "$INPUT" "$OUT_DIR" "$OUT_DIR/bench.m3u8" segment .ts $SEGMENT_DURATION 0 "${EXTRA_OPTS[@]}" > /dev/null 2>&1
+
+for ((run = 1; run <= RUNS; run++)); do
+    rm -rf "${OUT_DIR:?}"/*
+    echo ""
+    echo "--- Passe $run/$RUNS ---"
+    if ! "$SEGMENTER" "$INPUT" "$OUT_DIR" "$OUT_DIR/bench.m3u8" segment .ts $SEGMENT_DURATION 0 \
+        --perf-counters "${EXTRA_OPTS[@]}" 2>&1 | grep -E '^\[(Perf|Entrelaceur|Sortie|Cache)\]'; then
+        echo "Échec de la passe $run" >&2
+        exit 1
+    fi
+done
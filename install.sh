@@ -19,13 +19,14 @@ fi
 
 # 1. Compilation du segmenteur
 echo "Compilation du video_segmenter..."
-if [ -f "video_segmenter.c" ]; then
-    gcc -Wall -Wextra -O2 $(pkg-config --libs libavformat libavcodec libavutil) \
-        -o video_segmenter video_segmenter.c \
-        $(pkg-config --cflags libavformat libavcodec libavutil)
+if [ -f "video_segmenter.cpp" ]; then
+    g++ -std=c++23 -Wall -Wextra -O2 -pthread \
+        $(pkg-config --cflags libavformat libavcodec libavutil libswscale) \
+        -o video_segmenter video_segmenter.cpp \
+        $(pkg-config --libs libavformat libavcodec libavutil libswscale) -ldl
     echo "Compilation réussie"
 else
-    echo "Fichier video_segmenter.c introuvable"
+    echo "Fichier video_segmenter.cpp introuvable"
     exit 1
 fi
 
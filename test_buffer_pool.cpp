@@ -0,0 +1,120 @@
+// Tests du pool de buffers de paquets (PacketBufferPool) : partage des payloads
+// comptés, recopie des autres, retour des chunks au système, plafond, et
+// libération après la destruction du cache du thread.
+// make test-pool
+#define main video_segmenter_main
+#include "video_segmenter.cpp"
+#undef main
+
+int failures = 0;
+
+void check(bool ok, std::string_view what) {
+    std::println("  {} {}", ok ? "ok  " : "ÉCHEC", what);
+    if (!ok) failures++;
+}
+
+void test_ref_path() {
+    std::println("paquet compté : partagé sans copie");
+    PacketBufferPool &pool = PacketBufferPool::instance();
+    AVPacketGuard src;
+    check(av_new_packet(src, 4096) == 0, "av_new_packet");
+    std::memset(src->data, 0x5a, 4096);
+    src->pts = 42;
+
+    std::size_t copied = pool.copied_packets.load();
+    auto dst = pool.copy_packet(src);
+    check(dst.has_value(), "copy_packet");
+    if (!dst) return;
+    check((*dst)->data == src->data, "même payload");
+    check((*dst)->pts == 42, "propriétés reprises");
+    check(pool.copied_packets.load() == copied, "aucune copie");
+    av_packet_free(&*dst);
+}
+
+void test_copy_path() {
+    std::println("paquet non compté : recopié dans le pool");
+    PacketBufferPool &pool = PacketBufferPool::instance();
+    std::vector<uint8_t> payload(3000, 0xa5);
+    AVPacketGuard src;
+    src->data = payload.data();
+    src->size = static_cast<int>(payload.size());
+    src->dts = 7;
+
+    std::size_t copied = pool.copied_packets.load();
+    auto dst = pool.copy_packet(src);
+    check(dst.has_value(), "copy_packet");
+    if (!dst) return;
+    check((*dst)->buf != nullptr && (*dst)->data != payload.data(), "payload dans un bloc du pool");
+    check(std::memcmp((*dst)->data, payload.data(), payload.size()) == 0, "contenu identique");
+    bool padded = std::all_of((*dst)->data + payload.size(),
+                              (*dst)->data + payload.size() + AV_INPUT_BUFFER_PADDING_SIZE,
+                              [](uint8_t b) { return b == 0; });
+    check(padded, "padding à zéro");
+    check((*dst)->dts == 7, "propriétés reprises");
+    check(pool.copied_packets.load() == copied + 1, "une copie comptée");
+    src->data = nullptr;
+    src->size = 0;
+    av_packet_free(&*dst);
+}
+
+void test_release() {
+    std::println("chunks libres rendus au système");
+    PacketBufferPool &pool = PacketBufferPool::instance();
+    std::size_t before = pool.reserved_bytes();
+    std::size_t released = pool.released_chunks.load();
+
+    // 8 chunks de la classe 4 Ko, tous libérés
+    std::vector<AVBufferRef *> bufs;
+    for (std::size_t i = 0; i < 8 * (POOL_CHUNK_SIZE / 4096); i++) bufs.push_back(pool.acquire(4096));
+    check(pool.reserved_bytes() >= before + 7 * POOL_CHUNK_SIZE, "pool agrandi");
+    for (AVBufferRef *&b : bufs) av_buffer_unref(&b);
+
+    check(pool.released_chunks.load() > released, "chunks rendus");
+    // réserve du dépôt + un chunk tenu par le cache du thread
+    check(pool.reserved_bytes() <= before + (POOL_DEPOT_SLACK + 1) * POOL_CHUNK_SIZE, "empreinte revenue");
+}
+
+void test_cap() {
+    std::println("plafond POOL_MAX_BYTES");
+    PacketBufferPool &pool = PacketBufferPool::instance();
+    std::size_t fallback = pool.fallback_allocs.load();
+    std::vector<AVBufferRef *> bufs;
+    for (std::size_t i = 0; i < POOL_MAX_BYTES / POOL_CHUNK_SIZE + 8; i++) bufs.push_back(pool.acquire(POOL_CHUNK_SIZE));
+    check(std::ranges::all_of(bufs, [](AVBufferRef *b) { return b != nullptr; }), "toutes les allocations servies");
+    check(pool.reserved_bytes() <= POOL_MAX_BYTES, "pool plafonné");
+    check(pool.fallback_allocs.load() >= fallback + 8, "excédent hors pool");
+    for (AVBufferRef *&b : bufs) av_buffer_unref(&b);
+}
+
+// détruit après le cache du pool (thread_local construit avant lui)
+struct LateRelease {
+    AVBufferRef *buf = nullptr;
+    ~LateRelease() { av_buffer_unref(&buf); }
+};
+
+void test_thread_exit() {
+    std::println("libération après la fin du cache du thread");
+    PacketBufferPool &pool = PacketBufferPool::instance();
+    std::thread worker([&pool] {
+        thread_local LateRelease late;
+        late.buf = pool.acquire(1024);
+    });
+    worker.join();
+    AVBufferRef *again = pool.acquire(1024);
+    check(again != nullptr, "pool utilisable ensuite");
+    av_buffer_unref(&again);
+}
+
+int main() {
+    test_ref_path();
+    test_copy_path();
+    test_release();
+    test_cap();
+    test_thread_exit();
+    if (failures) {
+        std::println("{} vérification(s) en échec", failures);
+        return EXIT_FAILURE;
+    }
+    std::println("OK");
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#!/bin/bash
+
+#############################################
+# Test de bout en bout du segmenteur
+# Un clip court est segmenté jusqu'au bout : le dernier segment (trailer
+# compris) doit être écrit et la playlist finale publiée
+#############################################
+
+# Usage: ./test_segment_end.sh [segmenteur]
+
+SEGMENTER="${1:-./usr/local/bin/video_segmenter}"
+
+if [ ! -x "$SEGMENTER" ]; then
+    echo "Le binaire $SEGMENTER n'existe pas ou n'est pas exécutable" >&2
+    exit 1
+fi
+for tool in ffmpeg ffprobe; do
+    if ! command -v "$tool" > /dev/null; then
+        echo "$tool introuvable" >&2
+        exit 1
+    fi
+done
+
+TEST_DIR=$(mktemp -d "${TMPDIR:-/tmp}/segmenter_test.XXXXXX") || exit 1
+trap 'rm -rf "$TEST_DIR"' EXIT
+
+# 7 s, GOP d'1 s : trois segments de 2 s et un dernier d'1 s
+CLIP="$TEST_DIR/clip.mp4"
+if ! ffmpeg -v error -f lavfi -i testsrc2=size=320x240:rate=25 -f lavfi -i sine=frequency=440 \
+    -t 7 -c:v libx264 -preset ultrafast -g 25 -c:a aac -shortest "$CLIP"; then
+    echo "Impossible de générer le clip de test (ffmpeg)" >&2
+    exit 1
+fi
+
+FAILED=0
+
+fail() {
+    echo "  ÉCHEC: $1"
+    FAILED=$((FAILED + 1))
+}
+
+# segmente le clip avec les options données et vérifie la sortie complète
+check_run() {
+    local name="$1"
+    shift
+    local out="$TEST_DIR/$name"
+    mkdir -p "$out"
+    echo "--- $name ${*} ---"
+
+    "$SEGMENTER" "$CLIP" "$out" "$out/index.m3u8" segment .ts 2 0 "$@" > "$out.log" 2>&1
+    local status=$?
+    if [ "$status" -ne 0 ]; then
+        fail "code de sortie $status"
+        tail -n 5 "$out.log"
+        return
+    fi
+
+    local playlist="$out/index.m3u8"
+    if [ ! -f "$playlist" ]; then
+        fail "playlist finale absente"
+        return
+    fi
+    tail -n 1 "$playlist" | grep -q '^#EXT-X-ENDLIST' || fail "#EXT-X-ENDLIST absent"
+
+    local listed files
+    listed=$(grep -c '^#EXTINF' "$playlist")
+    files=$(find "$out" -name 'segment-*.ts' | wc -l)
+    [ "$listed" -ge 4 ] || fail "$listed segments listés, 4 attendus"
+    [ "$listed" -eq "$files" ] || fail "$listed segments listés pour $files fichiers"
+
+    local last
+    last=$(grep -v '^#' "$playlist" | tail -n 1)
+    if [ ! -s "$out/$last" ]; then
+        fail "dernier segment $last absent ou vide"
+    elif ! ffprobe -v error -show_entries format=duration -of csv=p=0 "$out/$last" > /dev/null; then
+        fail "dernier segment $last illisible"
+    fi
+
+    [ -z "$(find "$out" -name '*.tmp')" ] || fail "fichiers .tmp restants"
+}
+
+check_run direct
+check_run write-behind --write-behind=16777216 --writer-threads=2
+
+if [ "$FAILED" -gt 0 ]; then
+    echo "$FAILED vérification(s) en échec"
+    exit 1
+fi
+echo "OK"
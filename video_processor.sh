@@ -28,6 +28,69 @@ SEGMENT_DURATION=10
 MAX_SEGMENTS=0
 EXTENSION=".ts"
 
+# Suivi des fichiers encore en cours d'écriture (TS, MP4 fragmenté, MKV) :
+# la segmentation démarre sans attendre la fin de la copie. L'écrivain pose
+# "<fichier>.done" dans WATCH_DIR quand il a terminé.
+FOLLOW_MODE=0
+FOLLOW_IDLE_TIMEOUT=30
+
+# Pendant qu'une vidéo est segmentée, la suivante est préparée en arrière-plan :
+# contrôle de stabilité, lecture des premiers Mo (cache de pages) et probe.
+PREFETCH_NEXT=1
+PREFETCH_BYTES=$((16 * 1024 * 1024))
+
+# Concurrence adaptative : en lot, jusqu'à MAX_JOBS vidéos sont segmentées en
+# parallèle. Le nombre de jobs part de MIN_JOBS et suit une montée de colline
+# sur le débit agrégé (Mo/s) mesuré toutes les ADAPT_INTERVAL secondes ; un
+# écart de moins de ADAPT_TOLERANCE % est un plateau. MAX_JOBS=1 : séquentiel.
+MAX_JOBS=$(nproc 2>/dev/null || echo 1)
+MIN_JOBS=1
+ADAPT_INTERVAL=30
+ADAPT_TOLERANCE=5
+
+# Admission par pression (PSI, /proc/pressure) : quand la pression mémoire ou
+# I/O ("some avg10", en %) dépasse PRESSURE_HIGH, aucun job ne démarre et les
+# budgets mémoire des jobs en cours (file de paquets, cache) sont divisés par
+# deux, jusqu'à 25 % ; sous PRESSURE_LOW ils remontent et l'admission reprend.
+# Une pression CPU au-delà de PRESSURE_CPU_HIGH retarde seulement les départs.
+# Un job n'est admis que si MemAvailable couvre son estimation mémoire.
+PRESSURE_HIGH=20
+PRESSURE_LOW=5
+PRESSURE_CPU_HIGH=80
+PRESSURE_POLL=2
+QUEUE_BYTES=$((64 * 1024 * 1024))
+JOB_BUFFERS_BYTES=$((48 * 1024 * 1024))  # entrelaceur, AVIO, pool de paquets
+BUDGET_FILE="./var/run/video_segmenter.budget"
+# PID des segmenteurs lancés par ce script (un fichier vide par PID) : seuls
+# ceux-là reçoivent les demandes d'état et de budget
+SEGMENTER_PIDS="./var/run/video_segmenter.pids"
+
+# Statistiques par job pour le banc d'essai ("code octets durée cpu" par ligne) ;
+# vide = pas d'enregistrement
+JOB_STATS_FILE=""
+
+# Placement sur les cœurs : les jobs directs (pipe, channels) ont les cœurs
+# LIVE_CPUS (ex. "0-1") pour eux seuls, les jobs du lot se partagent les autres.
+# Avec NUMA_PLACEMENT=1 sur une machine multi-nœuds, chaque job du lot va sur le
+# nœud qui en a le moins (ses cœurs et la mémoire de ses pools de paquets).
+LIVE_CPUS=""
+NUMA_PLACEMENT=1
+
+# Chien de garde : une étape figée (lecture NFS, pipe bloqué) plus de
+# STALL_TIMEOUT secondes interrompt le job (code de sortie 75). Le script est la
+# seule couche de relance (le segmenteur tourne avec --max-restarts=0) : il
+# relance au plus MAX_RESTARTS fois avec --resume, après le dernier segment
+# publié. Un flux stdin n'est jamais relancé, ses octets consommés sont perdus.
+STALL_TIMEOUT=60
+MAX_RESTARTS=3
+EXIT_STALLED=75
+
+# Mode "pipe" avec secours : silence du primaire avant bascule (secondes)
+FAILOVER_TIMEOUT=3
+
+# Mode "channels" : threads de segmentation partagés par toutes les chaînes
+CHANNEL_WORKERS=4
+
 # Chemin vers le binaire
 SEGMENTER="./usr/local/bin/video_segmenter"
 #SEGMENTER="$HOME/Works/video_orchestrator/src/main/resources/usr/local/bin/video_segmenter"
@@ -48,11 +111,20 @@ error() {
 init_directories() {
     mkdir -p "$WATCH_DIR" "$OUTPUT_DIR" "$PROCESSING_DIR" "$DONE_DIR" "$ERROR_DIR"
     mkdir -p "$(dirname "$LOG_FILE")"
-    mkdir -p "$(dirname "$LOCK_FILE")"
+    mkdir -p "$(dirname "$LOCK_FILE")" "$SEGMENTER_PIDS"
     touch "$LOG_FILE"
 }
 
-# Vérifie si un fichier est en cours d'écriture (compatible Linux et macOS)
+# Taille d'un fichier (compatible Linux et macOS)
+file_size() {
+    if [[ "$OSTYPE" == "darwin"* ]]; then
+        stat -f%z "$1" 2>/dev/null || echo 0
+    else
+        stat -c%s "$1" 2>/dev/null || echo 0
+    fi
+}
+
+# Vérifie si un fichier est en cours d'écriture
 is_file_stable() {
     local file="$1"
 
@@ -62,19 +134,10 @@ is_file_stable() {
         return 1
     fi
 
-    # Détection du système d'exploitation
     local size1 size2
-    if [[ "$OSTYPE" == "darwin"* ]]; then
-        # macOS
-        size1=$(stat -f%z "$file" 2>/dev/null || echo 0)
-        sleep 2
-        size2=$(stat -f%z "$file" 2>/dev/null || echo 0)
-    else
-        # Linux
-        size1=$(stat -c%s "$file" 2>/dev/null || echo 0)
-        sleep 2
-        size2=$(stat -c%s "$file" 2>/dev/null || echo 0)
-    fi
+    size1=$(file_size "$file")
+    sleep 2
+    size2=$(file_size "$file")
 
     log "Vérification stabilité: taille1=$size1, taille2=$size2"
 
@@ -106,6 +169,145 @@ release_lock() {
     rm -f "$LOCK_FILE"
 }
 
+# Fichier d'état du préchargement (taille vue stable, en octets)
+prefetch_state() {
+    echo "$PROCESSING_DIR/.$(basename "$1").prefetched"
+}
+
+# Prépare la vidéo suivante pendant le traitement de la courante (arrière-plan)
+prefetch_video() {
+    local file="$1"
+    local state
+    state=$(prefetch_state "$file")
+
+    local size1 size2
+    size1=$(file_size "$file")
+    local started=$SECONDS
+    "$SEGMENTER" --prefetch "$file" "$PREFETCH_BYTES" >> "$LOG_FILE" 2>&1 || return 0
+
+    # même fenêtre de 2 s que is_file_stable, recouverte par le probe
+    local elapsed=$((SECONDS - started))
+    [ $elapsed -lt 2 ] && sleep $((2 - elapsed))
+    size2=$(file_size "$file")
+    if [ "$size1" -eq "$size2" ] && [ "$size2" -gt 0 ]; then
+        echo "$size2" > "$state"
+    fi
+}
+
+# "0-3,8" -> "0 1 2 3 8"
+expand_cpu_list() {
+    local -a items cpus=()
+    local item c
+    IFS=',' read -ra items <<< "$1"
+    for item in "${items[@]}"; do
+        for ((c = ${item%-*}; c <= ${item#*-}; c++)); do
+            cpus+=("$c")
+        done
+    done
+    echo "${cpus[*]}"
+}
+
+# Cœurs de la liste $1 hors LIVE_CPUS, au format "0,2,3"
+batch_cpus() {
+    local live=" $(expand_cpu_list "$LIVE_CPUS") "
+    local -a kept=()
+    local c
+    for c in $(expand_cpu_list "$1"); do
+        [[ "$live" == *" $c "* ]] || kept+=("$c")
+    done
+    local IFS=','
+    echo "${kept[*]}"
+}
+
+# Nœuds NUMA (un par ligne), rien si la machine n'en a qu'un
+numa_nodes() {
+    [ "$NUMA_PLACEMENT" = "1" ] || return 0
+    local -a nodes=()
+    local dir
+    for dir in /sys/devices/system/node/node[0-9]*; do
+        [ -d "$dir" ] && nodes+=("${dir##*node}")
+    done
+    [ ${#nodes[@]} -gt 1 ] && printf '%s\n' "${nodes[@]}" | sort -n
+}
+
+# Options de placement d'un job du lot sur le nœud $1 (vide = sans NUMA)
+job_placement() {
+    local node="$1"
+    local cpus=""
+    [ -z "$node" ] && [ -z "$LIVE_CPUS" ] && return 0
+    if [ -n "$node" ]; then
+        cpus=$(batch_cpus "$(cat "/sys/devices/system/node/node$node/cpulist")")
+        echo "--numa-node=$node"
+    fi
+    # nœud entièrement réservé au direct : n'importe quel cœur du lot
+    [ -z "$cpus" ] && cpus=$(batch_cpus "$(cat /sys/devices/system/cpu/online)")
+    [ -n "$cpus" ] && echo "--cpus=$cpus"
+}
+
+# Placement des jobs directs : les cœurs réservés
+JOB_PLACEMENT=()
+live_placement() {
+    [ -n "$LIVE_CPUS" ] && JOB_PLACEMENT=(--cpus="$LIVE_CPUS")
+}
+
+# Lance le segmenteur et inscrit son PID dans SEGMENTER_PIDS le temps du job.
+# Un job en arrière-plan lit /dev/null par défaut : stdin est transmis (flux "-")
+run_tracked_segmenter() {
+    "$SEGMENTER" "$@" <&0 &
+    local pid=$!
+    local status
+    : > "$SEGMENTER_PIDS/$pid"
+    wait "$pid"
+    status=$?
+    rm -f "$SEGMENTER_PIDS/$pid"
+    return $status
+}
+
+# Envoie le signal $1 aux segmenteurs inscrits ; échoue si aucun ne tourne
+signal_segmenters() {
+    local sig="$1"
+    local exe file pid sent=1
+    exe=$(readlink -f "$SEGMENTER")
+    for file in "$SEGMENTER_PIDS"/*; do
+        [ -e "$file" ] || continue
+        pid=${file##*/}
+        # job disparu sans nettoyer (PID peut-être réattribué) : inscription périmée
+        if [ ! -d "/proc/$pid" ]; then
+            rm -f "$file"
+            continue
+        fi
+        # pas encore (ou plus) le segmenteur : fork pas encore exécuté
+        [ "$(readlink "/proc/$pid/exe" 2>/dev/null)" = "$exe" ] || continue
+        kill -"$sig" "$pid" 2>/dev/null && sent=0
+    done
+    return $sent
+}
+
+# Lance le segmenteur ; après un blocage (code 75), relance avec --resume
+run_segmenter() {
+    local attempt=0
+    local status
+    local -a resume=()
+    while true; do
+        run_tracked_segmenter "$@" --stall-timeout="$STALL_TIMEOUT" --max-restarts=0 \
+            --queue-bytes="$QUEUE_BYTES" --budget-file="$BUDGET_FILE" "${JOB_PLACEMENT[@]}" "${resume[@]}" >> "$LOG_FILE" 2>&1
+        status=$?
+        [ $status -ne $EXIT_STALLED ] && return $status
+        if [ "$1" = "-" ]; then
+            error "Flux stdin bloqué, pas de relance (entrée déjà consommée)"
+            return $status
+        fi
+
+        attempt=$((attempt + 1))
+        if [ $attempt -gt $MAX_RESTARTS ]; then
+            error "Segmenteur bloqué, abandon après $MAX_RESTARTS relances"
+            return $status
+        fi
+        log "Segmenteur bloqué, relance $attempt/$MAX_RESTARTS depuis le dernier segment publié"
+        resume=(--resume)
+    done
+}
+
 # Traite une vidéo
 process_video() {
     local input_file="$1"
@@ -123,12 +325,30 @@ process_video() {
         return 1
     fi
 
+    local -a segmenter_opts=()
+    if [ "$FOLLOW_MODE" = "1" ]; then
+        log "Mode suivi: segmentation pendant l'écriture"
+        segmenter_opts+=(--follow --follow-idle-timeout="$FOLLOW_IDLE_TIMEOUT" --follow-done-marker="$input_file.done")
+    fi
+
+    # Stabilité déjà vérifiée par le préchargement si la taille n'a pas bougé
+    local prefetched=0
+    local state
+    state=$(prefetch_state "$input_file")
+    if [ -f "$state" ]; then
+        if [ "$(cat "$state")" = "$(file_size "$processing_file")" ]; then
+            prefetched=1
+            log "Fichier préchargé et stable, pas d'attente"
+        fi
+        rm -f "$state"
+    fi
+
     # Vérifie que le fichier est stable
-    log "Vérification de la stabilité du fichier..."
+    [ "$FOLLOW_MODE" = "1" ] || [ $prefetched = 1 ] || log "Vérification de la stabilité du fichier..."
     local attempts=0
     local max_attempts=5  # Réduit de 10 à 5 pour 10 secondes total
 
-    while ! is_file_stable "$processing_file"; do
+    while [ "$FOLLOW_MODE" != "1" ] && [ $prefetched != 1 ] && ! is_file_stable "$processing_file"; do
         attempts=$((attempts + 1))
         if [ $attempts -gt $max_attempts ]; then
             error "Timeout: le fichier n'est pas stable après $((max_attempts * 2)) secondes"
@@ -142,7 +362,7 @@ process_video() {
         log "Tentative $attempts/$max_attempts - Fichier potentiellement en cours d'écriture, attente..."
     done
 
-    log "Fichier stable, début du traitement"
+    log "Début du traitement"
 
     # Prépare les chemins de sortie
     local output_subdir="$OUTPUT_DIR/$name_without_ext"
@@ -152,10 +372,11 @@ process_video() {
 
     # Lance la segmentation
     log "Lancement de la segmentation..."
-    log "Commande: $SEGMENTER \"$processing_file\" \"$output_subdir\" \"$index_file\" \"segment\" \"$EXTENSION\" $SEGMENT_DURATION $MAX_SEGMENTS"
+    log "Commande: $SEGMENTER \"$processing_file\" \"$output_subdir\" \"$index_file\" \"segment\" \"$EXTENSION\" $SEGMENT_DURATION $MAX_SEGMENTS ${segmenter_opts[*]}"
 
-    if "$SEGMENTER" "$processing_file" "$output_subdir" "$index_file" "segment" "$EXTENSION" $SEGMENT_DURATION $MAX_SEGMENTS >> "$LOG_FILE" 2>&1; then
+    if run_segmenter "$processing_file" "$output_subdir" "$index_file" "segment" "$EXTENSION" $SEGMENT_DURATION $MAX_SEGMENTS "${segmenter_opts[@]}"; then
         log "Segmentation réussie: $filename"
+        rm -f "$input_file.done"
 
         # Déplace vers done
         mv "$processing_file" "$DONE_DIR/"
@@ -178,6 +399,334 @@ EOF
     fi
 }
 
+# Segmente un flux lu sur stdin (TS, MP4 fragmenté, MKV) sans passer par WATCH_DIR
+# Exemple: ffmpeg -i src -c copy -f mpegts - | video_processor.sh pipe ma_chaine
+process_stream() {
+    local name="$1"
+    local format="${2:-mpegts}"
+    local backup="${3:-}"
+
+    if [ -z "$name" ]; then
+        error "Nom de flux manquant (usage: $0 pipe <nom> [format])"
+        return 1
+    fi
+
+    local output_subdir="$OUTPUT_DIR/$name"
+    local index_file="$output_subdir/${name}.m3u8"
+    mkdir -p "$output_subdir"
+
+    # entrée de secours démuxée en attente : bascule si stdin se tait
+    local -a backup_opts=()
+    if [ -n "$backup" ]; then
+        backup_opts=(--backup-input="$backup" --failover-timeout="$FAILOVER_TIMEOUT")
+    fi
+
+    log "Segmentation du flux stdin: $name (format: $format${backup:+, secours: $backup})"
+    live_placement
+    if run_segmenter - "$output_subdir" "$index_file" "segment" "$EXTENSION" $SEGMENT_DURATION $MAX_SEGMENTS \
+        --input-format="$format" "${backup_opts[@]}"; then
+        log "Flux terminé: $name"
+        return 0
+    else
+        error "Échec de la segmentation du flux: $name"
+        return 1
+    fi
+}
+
+# Segmente toutes les chaînes directes d'une liste dans un seul processus
+# (une ligne "nom entrée [format]" par chaîne, entrées udp://, unix:, FIFO)
+process_channels() {
+    local list="$1"
+
+    if [ ! -f "$list" ]; then
+        error "Liste de chaînes introuvable (usage: $0 channels <liste>)"
+        return 1
+    fi
+
+    log "Ingestion multi-chaînes: $list ($CHANNEL_WORKERS workers)"
+    live_placement
+    if run_tracked_segmenter "$list" "$OUTPUT_DIR" "index.m3u8" "segment" "$EXTENSION" $SEGMENT_DURATION $MAX_SEGMENTS \
+        --channels --channel-workers="$CHANNEL_WORKERS" "${JOB_PLACEMENT[@]}" >> "$LOG_FILE" 2>&1; then
+        log "Chaînes terminées: $list"
+        return 0
+    else
+        error "Échec de l'ingestion multi-chaînes: $list"
+        return 1
+    fi
+}
+
+# Demande un instantané d'état (SIGUSR1) à chaque segmenteur lancé par le
+# script et l'affiche
+show_status() {
+    if ! signal_segmenters USR1; then
+        log "Aucun segmenteur en cours"
+        return 0
+    fi
+    sleep 0.5
+    find "$OUTPUT_DIR" -name '*.status.json' -newermt '-2 seconds' -print -exec cat {} \;
+}
+
+# Horodatage en secondes (fraction comprise)
+now_seconds() {
+    date +%s.%N
+}
+
+# Compteurs CPU globaux (/proc/stat) : "occupé total iowait" en ticks
+cpu_snapshot() {
+    awk '/^cpu / { busy = $2 + $3 + $4 + $7 + $8 + $9; print busy, busy + $5 + $6, $6; exit }' /proc/stat 2>/dev/null \
+        || echo "0 0 0"
+}
+
+# Temps CPU (user + sys) des enfants, à partir d'une sortie de `times` : le
+# builtin doit écrire dans un fichier, un pipe le ferait tourner dans un
+# sous-shell sans enfants
+children_cpu_seconds() {
+    awk 'NR == 2 {
+        total = 0
+        for (i = 1; i <= 2; i++) { split($i, t, /[ms]/); total += t[1] * 60 + t[2] }
+        print total
+    }' "$1"
+}
+
+# Lance process_video en arrière-plan ; le résultat (code, octets, durée, CPU)
+# est écrit dans $2 à la fin du job ; $3 : options de placement
+start_job() {
+    local video="$1"
+    local result="$2"
+    (
+        mapfile -t JOB_PLACEMENT <<< "$3"
+        [ -n "${JOB_PLACEMENT[0]}" ] || JOB_PLACEMENT=()
+        local bytes started status
+        bytes=$(file_size "$video")
+        started=$(now_seconds)
+        process_video "$video"
+        status=$?
+        times > "$result.times"
+        echo "$status $bytes $(awk -v a="$started" -v b="$(now_seconds)" 'BEGIN { print b - a }') $(children_cpu_seconds "$result.times")" > "$result"
+        [ -n "$JOB_STATS_FILE" ] && cat "$result" >> "$JOB_STATS_FILE"
+    ) &
+}
+
+# Pression "some avg10" (%) d'une ressource, 0 si PSI est indisponible
+pressure_avg10() {
+    awk '/^some/ { split($2, a, "="); print a[2]; exit }' "/proc/pressure/$1" 2>/dev/null || echo 0
+}
+
+mem_available_bytes() {
+    awk '/^MemAvailable:/ { printf "%.0f\n", $2 * 1024; exit }' /proc/meminfo 2>/dev/null
+}
+
+# Mémoire d'un job au budget courant : file de paquets + buffers fixes
+job_memory_estimate() {
+    echo $((QUEUE_BYTES * BUDGET_PERCENT / 100 + JOB_BUFFERS_BYTES))
+}
+
+BUDGET_PERCENT=100
+PRESSURE_LEVEL="low"
+ADMISSION_DEFERRED=0
+
+# Publie le pourcentage de budget et prévient les segmenteurs en cours (SIGUSR2)
+set_memory_budget() {
+    local percent=$1
+    [ "$percent" -eq "$BUDGET_PERCENT" ] && return 0
+    BUDGET_PERCENT=$percent
+    echo "$percent" > "$BUDGET_FILE.tmp" && mv "$BUDGET_FILE.tmp" "$BUDGET_FILE"
+    signal_segmenters USR2
+    log "[Pression] Budgets mémoire des jobs à ${percent}%"
+}
+
+# Relit la pression PSI, met à jour PRESSURE_LEVEL et les budgets mémoire
+poll_pressure() {
+    local mem io cpu
+    mem=$(pressure_avg10 memory)
+    io=$(pressure_avg10 io)
+    cpu=$(pressure_avg10 cpu)
+    PRESSURE_LEVEL=$(awk -v m="$mem" -v i="$io" -v c="$cpu" -v hi="$PRESSURE_HIGH" -v lo="$PRESSURE_LOW" -v chi="$PRESSURE_CPU_HIGH" 'BEGIN {
+        if (m >= hi || i >= hi) print "high"
+        else if (c >= chi) print "cpu"
+        else if (m < lo && i < lo) print "low"
+        else print "mid"
+    }')
+    case "$PRESSURE_LEVEL" in
+        high) set_memory_budget $((BUDGET_PERCENT / 2 < 25 ? 25 : BUDGET_PERCENT / 2)) ;;
+        low)  set_memory_budget $((BUDGET_PERCENT * 2 > 100 ? 100 : BUDGET_PERCENT * 2)) ;;
+    esac
+    PRESSURE_SUMMARY="mémoire ${mem}%, I/O ${io}%, CPU ${cpu}%"
+}
+
+# Un nouveau job peut-il démarrer ($1 = jobs en cours) ? Sans job en cours,
+# toujours : le lot avance, au rythme d'un job à la fois
+admit_job() {
+    local running=$1
+    [ "$running" -eq 0 ] && return 0
+
+    local reason=""
+    case "$PRESSURE_LEVEL" in
+        high|cpu) reason="pression $PRESSURE_SUMMARY" ;;
+    esac
+    local available
+    available=$(mem_available_bytes)
+    if [ -z "$reason" ] && [ -n "$available" ] && [ "$available" -lt "$(job_memory_estimate)" ]; then
+        reason="$((available / 1048576)) Mo disponibles < $(($(job_memory_estimate) / 1048576)) Mo estimés"
+    fi
+
+    if [ -n "$reason" ]; then
+        [ $ADMISSION_DEFERRED = 1 ] || log "[Pression] Nouveaux jobs différés ($running en cours) : $reason"
+        ADMISSION_DEFERRED=1
+        return 1
+    fi
+    [ $ADMISSION_DEFERRED = 1 ] && log "[Pression] Reprise des admissions ($PRESSURE_SUMMARY)"
+    ADMISSION_DEFERRED=0
+    return 0
+}
+
+# État du contrôleur, gardé d'un passage à l'autre en mode watch
+CURRENT_JOBS=$MIN_JOBS
+ADAPT_DIRECTION=1
+ADAPT_LAST_RATE=0
+
+# Une décision de la montée de colline à partir d'une fenêtre de mesure :
+# débit agrégé, occupation CPU, iowait et CPU consommé par seconde de job
+adapt_concurrency() {
+    local bytes="$1" seconds="$2" cpu_delta="$3" job_wall="$4" job_cpu="$5"
+    local busy total iowait
+    read -r busy total iowait <<< "$cpu_delta"
+
+    local decision
+    decision=$(awk -v bytes="$bytes" -v secs="$seconds" -v busy="$busy" -v total="$total" -v iow="$iowait" \
+                   -v wall="$job_wall" -v cpu="$job_cpu" -v last="$ADAPT_LAST_RATE" -v dir="$ADAPT_DIRECTION" \
+                   -v jobs="$CURRENT_JOBS" -v min="$MIN_JOBS" -v max="$MAX_JOBS" -v tol="$ADAPT_TOLERANCE" \
+                   -v ncpu="$(nproc 2>/dev/null || echo 1)" 'BEGIN {
+        rate = bytes / 1048576 / secs
+        busy_pct = total > 0 ? 100 * busy / total : 0
+        iow_pct = total > 0 ? 100 * iow / total : 0
+        per_job = wall > 0 ? cpu / wall : 0          # coeurs consommés par job
+        kind = per_job >= 0.8 ? "CPU" : "I/O"
+
+        if (last > 0 && rate < last * (1 - tol / 100)) dir = -dir   # pire : demi-tour
+        # CPU saturé par des jobs CPU : monter ne peut que ralentir
+        if (dir > 0 && kind == "CPU" && (busy_pct >= 95 || jobs >= ncpu)) dir = -1
+        # disque saturé et débit en baisse : descendre
+        if (dir > 0 && iow_pct >= 30 && last > 0 && rate < last) dir = -1
+
+        next_jobs = jobs + dir
+        if (next_jobs > max) { next_jobs = max; dir = -1 }
+        if (next_jobs < min) { next_jobs = min; dir = 1 }
+        printf "%d %d %.2f %.0f %.0f %.2f %s\n", next_jobs, dir, rate, busy_pct, iow_pct, per_job, kind
+    }')
+
+    local next dir rate busy_pct iow_pct per_job kind
+    read -r next dir rate busy_pct iow_pct per_job kind <<< "$decision"
+    log "[Adaptatif] ${rate} Mo/s (préc. ${ADAPT_LAST_RATE}), CPU ${busy_pct}%, iowait ${iow_pct}%, ${per_job} coeur/job (${kind}) : $CURRENT_JOBS -> $next jobs"
+    CURRENT_JOBS=$next
+    ADAPT_DIRECTION=$dir
+    ADAPT_LAST_RATE=$rate
+}
+
+# Traite les vidéos données avec CURRENT_JOBS jobs simultanés, réajusté en route
+process_videos_parallel() {
+    local -a videos=("$@")
+    local results_dir
+    results_dir=$(mktemp -d "${TMPDIR:-/tmp}/video_processor.XXXXXX") || return 1
+    [ "$CURRENT_JOBS" -ge "$MIN_JOBS" ] 2>/dev/null || CURRENT_JOBS=$MIN_JOBS
+
+    local -A running=()
+    local -A running_node=()
+    local -a nodes
+    mapfile -t nodes < <(numa_nodes)
+    local next=0 success=0 failed=0 sleeper="" prefetch_pid="" prefetched=-1
+    local window_start window_cpu window_bytes=0 window_wall=0 window_job_cpu=0 window_jobs=0
+    window_start=$(now_seconds)
+    window_cpu=$(cpu_snapshot)
+
+    while [ $next -lt ${#videos[@]} ] || [ ${#running[@]} -gt 0 ]; do
+        poll_pressure
+        while [ ${#running[@]} -lt "$CURRENT_JOBS" ] && [ $next -lt ${#videos[@]} ]; do
+            admit_job ${#running[@]} || break
+            local video="${videos[$next]}"
+            next=$((next + 1))
+            # le préchargement de cette vidéo doit être fini avant de la déplacer
+            if [ -n "$prefetch_pid" ]; then
+                wait "$prefetch_pid" 2>/dev/null
+                prefetch_pid=""
+            fi
+            [ -f "$video" ] || continue
+
+            # nœud qui a le moins de jobs en cours
+            local node="" best=-1 candidate load pid
+            for candidate in "${nodes[@]}"; do
+                load=0
+                for pid in "${!running_node[@]}"; do
+                    [ "${running_node[$pid]}" = "$candidate" ] && load=$((load + 1))
+                done
+                if [ $best -lt 0 ] || [ $load -lt $best ]; then
+                    node=$candidate
+                    best=$load
+                fi
+            done
+
+            start_job "$video" "$results_dir/$next" "$(job_placement "$node")"
+            running[$!]="$results_dir/$next"
+            running_node[$!]="$node"
+        done
+
+        # tous les jobs occupés (ou admission différée) : la prochaine vidéo de
+        # la file est préparée pendant l'attente, comme en séquentiel
+        if [ "$PREFETCH_NEXT" = "1" ] && [ "$FOLLOW_MODE" != "1" ] && [ $next -lt ${#videos[@]} ] \
+            && [ $prefetched -ne $next ]; then
+            prefetch_video "${videos[$next]}" &
+            prefetch_pid=$!
+            prefetched=$next
+        fi
+        [ ${#running[@]} -gt 0 ] || continue
+
+        # fin d'un job ou, au plus tard, nouvelle lecture de la pression. Le
+        # minuteur n'est jamais tué : un fils bash tué avant son exec lancerait
+        # le trap EXIT de l'appelant
+        if [ -z "$sleeper" ] || ! kill -0 "$sleeper" 2>/dev/null; then
+            sleep "$PRESSURE_POLL" &
+            sleeper=$!
+        fi
+        wait -n 2>/dev/null
+        local pid
+        for pid in "${!running[@]}"; do
+            kill -0 "$pid" 2>/dev/null && continue
+            wait "$pid" 2>/dev/null
+            local status=1 bytes=0 wall=0 cpu=0
+            [ -f "${running[$pid]}" ] && read -r status bytes wall cpu < "${running[$pid]}"
+            unset "running[$pid]" "running_node[$pid]"
+            if [ "$status" = "0" ]; then
+                success=$((success + 1))
+            else
+                failed=$((failed + 1))
+            fi
+            window_bytes=$((window_bytes + bytes))
+            window_wall=$(awk -v a="$window_wall" -v b="$wall" 'BEGIN { print a + b }')
+            window_job_cpu=$(awk -v a="$window_job_cpu" -v b="$cpu" 'BEGIN { print a + b }')
+            window_jobs=$((window_jobs + 1))
+        done
+
+        local now elapsed
+        now=$(now_seconds)
+        elapsed=$(awk -v a="$window_start" -v b="$now" 'BEGIN { print b - a }')
+        if [ $window_jobs -gt 0 ] && awk -v e="$elapsed" -v i="$ADAPT_INTERVAL" 'BEGIN { exit !(e >= i) }'; then
+            local cpu_now
+            cpu_now=$(cpu_snapshot)
+            adapt_concurrency "$window_bytes" "$elapsed" \
+                "$(awk -v a="$window_cpu" -v b="$cpu_now" 'BEGIN { split(a, x, " "); split(b, y, " "); print y[1] - x[1], y[2] - x[2], y[3] - x[3] }')" \
+                "$window_wall" "$window_job_cpu"
+            window_start=$now
+            window_cpu=$cpu_now
+            window_bytes=0 window_wall=0 window_job_cpu=0 window_jobs=0
+        fi
+    done
+    [ -n "$prefetch_pid" ] && wait "$prefetch_pid" 2>/dev/null
+
+    rm -rf "$results_dir"
+    PARALLEL_SUCCESS=$success
+    PARALLEL_FAILED=$failed
+}
+
 # Traite tous les MP4 du dossier
 process_all_videos() {
     local count=0
@@ -186,21 +735,76 @@ process_all_videos() {
 
     log "Recherche de vidéos à traiter dans: $WATCH_DIR"
 
-    # Parcourt tous les fichiers MP4
+    # Liste figée au départ : la vidéo suivante est connue pendant le traitement
+    local -a videos=()
     for video in "$WATCH_DIR"/*.mp4; do
         # Vérifie si le fichier existe (le glob peut ne rien trouver)
-        if [ ! -f "$video" ]; then
-            continue
+        [ -f "$video" ] && videos+=("$video")
+    done
+
+    # en parallèle, la vidéo suivante est préchargée quand tous les jobs sont occupés
+    if [ "$MAX_JOBS" -gt 1 ] && [ ${#videos[@]} -gt 1 ]; then
+        log "Traitement parallèle: ${#videos[@]} vidéo(s), ${CURRENT_JOBS}/${MAX_JOBS} jobs"
+        process_videos_parallel "${videos[@]}"
+        count=${#videos[@]}
+        success=$PARALLEL_SUCCESS
+        failed=$PARALLEL_FAILED
+        videos=()
+    fi
+
+    local -a nodes
+    mapfile -t nodes < <(numa_nodes)
+
+    local i prefetch_pid=""
+    for ((i = 0; i < ${#videos[@]}; i++)); do
+        local video="${videos[$i]}"
+        [ -f "$video" ] || continue
+
+        # le préchargement de la vidéo courante doit être fini avant de la déplacer
+        if [ -n "$prefetch_pid" ]; then
+            wait "$prefetch_pid" 2>/dev/null
+            prefetch_pid=""
+        fi
+
+        local next="${videos[$((i + 1))]:-}"
+        if [ "$PREFETCH_NEXT" = "1" ] && [ "$FOLLOW_MODE" != "1" ] && [ -n "$next" ]; then
+            prefetch_video "$next" &
+            prefetch_pid=$!
         fi
 
         count=$((count + 1))
+        local bytes started cpu_before=""
+        if [ -n "$JOB_STATS_FILE" ]; then
+            bytes=$(file_size "$video")
+            started=$(now_seconds)
+            times > "$JOB_STATS_FILE.times"
+            cpu_before=$(children_cpu_seconds "$JOB_STATS_FILE.times")
+        fi
+
+        # un seul job à la fois : il est toujours admis, seuls les budgets suivent la pression
+        poll_pressure
+
+        # nœuds NUMA à tour de rôle
+        local node=""
+        [ ${#nodes[@]} -gt 0 ] && node=${nodes[$((i % ${#nodes[@]}))]}
+        mapfile -t JOB_PLACEMENT < <(job_placement "$node")
 
-        if process_video "$video"; then
+        local status=0
+        process_video "$video" || status=1
+        if [ $status = 0 ]; then
             success=$((success + 1))
         else
             failed=$((failed + 1))
         fi
+
+        if [ -n "$cpu_before" ]; then
+            times > "$JOB_STATS_FILE.times"
+            echo "$status $bytes $(awk -v a="$started" -v b="$(now_seconds)" 'BEGIN { print b - a }')" \
+                "$(awk -v a="$cpu_before" -v b="$(children_cpu_seconds "$JOB_STATS_FILE.times")" 'BEGIN { print b - a }')" >> "$JOB_STATS_FILE"
+            rm -f "$JOB_STATS_FILE.times"
+        fi
     done
+    [ -n "$prefetch_pid" ] && wait "$prefetch_pid" 2>/dev/null
 
     if [ $count -gt 0 ]; then
         log "========================================="
@@ -248,6 +852,20 @@ main() {
         exit 1
     fi
 
+    # Un flux stdin ne touche pas WATCH_DIR : pas de verrou global
+    if [ "${1:-}" = "pipe" ]; then
+        process_stream "${2:-}" "${3:-}" "${4:-}"
+        exit $?
+    fi
+    if [ "${1:-}" = "status" ]; then
+        show_status
+        exit $?
+    fi
+    if [ "${1:-}" = "channels" ]; then
+        process_channels "${2:-}"
+        exit $?
+    fi
+
     # Vérifie le lock
     if ! acquire_lock; then
         exit 1
@@ -256,6 +874,9 @@ main() {
     # Trap pour libérer le lock à la sortie
     trap release_lock EXIT INT TERM
 
+    # budgets pleins au départ : le fichier d'un lot précédent est obsolète
+    rm -f "$BUDGET_FILE"
+
     # Parse les arguments
     case "${1:-}" in
         watch)
@@ -270,6 +891,9 @@ main() {
     esac
 }
 
+# Chargé par "source" (benchmark.sh) : fonctions seules, sans lancer le script
+[ "${BASH_SOURCE[0]}" = "$0" ] || return 0
+
 # Affiche l'aide
 if [ "$1" = "-h" ] || [ "$1" = "--help" ]; then
     cat <<EOF
@@ -279,6 +903,11 @@ OPTIONS:
   (aucun)       Traite tous les MP4 du dossier une seule fois
   watch         Mode surveillance continue (boucle infinie)
   cleanup [N]   Nettoie les fichiers de plus de N jours (défaut: 7)
+  pipe NOM [F] [SECOURS]
+                Segmente le flux lu sur stdin (format F, défaut: mpegts),
+                avec bascule sur l'entrée SECOURS si stdin se tait
+  channels LISTE  Segmente en un processus toutes les chaînes directes de LISTE
+  status        Instantané d'état des segmenteurs en cours (SIGUSR1)
   -h, --help    Affiche cette aide
 
 CONFIGURATION:
@@ -286,12 +915,19 @@ CONFIGURATION:
   - WATCH_DIR: dossier surveillé
   - OUTPUT_DIR: dossier de sortie
   - SEGMENT_DURATION: durée des segments
+  - FOLLOW_MODE: segmente pendant l'écriture du fichier
+  - PREFETCH_NEXT: prépare la vidéo suivante pendant le traitement
+  - MAX_JOBS: jobs simultanés max (ajustés selon le débit mesuré)
+  - PRESSURE_HIGH/PRESSURE_LOW: seuils PSI d'admission des jobs
+  - LIVE_CPUS: cœurs réservés aux jobs directs (pipe, channels)
   - etc.
 
 EXEMPLES:
   $0                    # Traite une fois
   $0 watch              # Surveillance continue
   $0 cleanup 14         # Nettoie les fichiers de +14 jours
+  ffmpeg -i src -c copy -f mpegts - | $0 pipe direct
+  $0 channels /etc/segmenter/channels.conf
 
 LOGS:
   $LOG_FILE
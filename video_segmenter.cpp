@@ -1,13 +1,46 @@
 #include <cstdlib>
+#include <cstdio>
 #include <cstring>
 #include <cmath>
 #include <cerrno>
+#include <climits>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/file.h>
+#include <poll.h>
+#include <sys/resource.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sched.h>
+#include <linux/mempolicy.h>
+#include <execinfo.h>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <ctime>
+#endif
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
 #include <unistd.h>
+#include <pthread.h>
+#include <csignal>
 
 #include <string>
 #include <vector>
+#include <array>
+#include <algorithm>
 #include <queue>
+#include <atomic>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
@@ -15,11 +48,23 @@
 #include <expected>
 #include <print>
 #include <filesystem>
+#include <deque>
+#include <string_view>
+#include <charconv>
+#include <utility>
+#include <chrono>
+#include <memory>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <set>
 
 extern "C" {
 #include "libavformat/avformat.h"
 #include "libavcodec/avcodec.h"
 #include "libavutil/mathematics.h"
+#include "libavutil/opt.h"
+#include "libswscale/swscale.h"
 }
 
 // manage error
@@ -39,16 +84,355 @@ constexpr int MAX_SEGMENTS = 4096;
 #define MAX_SEGMENTS        4096
 #define FF_INPUT_BUF_SIZE   128
 
+constexpr std::size_t INPUT_AVIO_BUFFER_SIZE = 256 * 1024;
+
+enum class ShardPolicy { RoundRobin, Hash, Adaptive };
+
+// une rendition de l'échelle ABR : hauteur et débit vidéo cible
+struct RenditionSpec {
+    int height = 0;
+    int64_t bitrate = 0;  // bit/s
+};
+
+// suivi d'un fichier encore en cours d'écriture
+struct FollowOptions {
+    double idle_timeout = 30.0;  // secondes sans nouvelles données avant EOF
+    std::string done_marker;     // fichier posé par l'écrivain en fin d'écriture
+};
+
+// options de la ligne de commande (positionnels + --cle=valeur)
+struct SegmenterOptions {
+    std::string input_file;
+    std::string output_dir;
+    std::string index_file;
+    std::string base_name;
+    std::string extension;
+    int segment_duration = 0;
+    int max_segments = 0;
+
+    std::size_t queue_capacity = 256;
+    std::size_t queue_bytes = 0;           // 0 = borne en nombre de paquets seulement
+    std::string budget_file;               // % des budgets mémoire, relu sur SIGUSR2
+    std::size_t interleave_max_bytes = 32 * 1024 * 1024;
+    double interleave_max_delay = 2.0;
+
+    std::vector<std::string> shard_dirs;   // vide = output_dir seul
+    std::vector<std::string> shard_uris;   // préfixes d'URI, un par dossier
+    ShardPolicy shard_policy = ShardPolicy::RoundRobin;
+
+    std::string input_format;              // indice de format pour stdin/pipe
+    std::optional<FollowOptions> follow;
+    bool thumbnails = false;               // vignettes + planche WebVTT
+    int thumb_width = 160;
+    unsigned int thumb_workers = 1;
+    int sprite_columns = 10;               // planche de N x N vignettes
+
+    std::vector<RenditionSpec> abr_ladder;  // vide = copie sans transcodage
+    std::string abr_encoder = "libx264";
+    std::string abr_preset = "veryfast";
+
+    std::string backup_input;              // entrée de secours démuxée en attente (direct)
+    double failover_timeout = 3.0;         // s de silence du primaire avant bascule
+    bool standby = false;                  // attend le verrou du dossier puis reprend la playlist
+    bool perf_counters = false;            // compteurs matériels autour de la boucle de segmentation
+    std::string status_file;               // instantané écrit sur SIGUSR1 (défaut <playlist>.status.json)
+    double latency_slo = 0.0;              // s, arrivée -> playlist; 0 = pas d'alerte
+    double stall_timeout = 0.0;            // s sans progrès d'une étape; 0 = pas de chien de garde
+    unsigned int max_restarts = 3;         // reprises internes après blocage
+    bool resume = false;                   // reprend depuis le dernier segment publié
+
+    bool channels = false;                 // input_file = liste de chaînes en direct (epoll)
+    unsigned int channel_workers = 4;      // threads de démux/segmentation partagés
+    std::size_t channel_buffer = 1024 * 1024;  // anneau d'entrée par chaîne
+
+    std::size_t write_behind_bytes = 0;    // 0 = écriture directe par le muxer
+    unsigned int writer_threads = 2;
+
+    std::size_t avio_buffer_size = 0;      // 0 = adapté au débit
+    std::size_t write_coalesce_bytes = 0;  // blocs du cache d'écriture, 0 = 8 buffers AVIO
+    int inject_write_latency_ms = 0;       // banc d'essai : disque lent simulé
+
+    std::string profile_file;              // piles repliées (flamegraph); vide = pas de profilage
+    unsigned int profile_hz = 99;
+
+    std::vector<int> cpus;                 // cœurs du job (vide = ceux hérités)
+    int numa_node = -1;                    // nœud des pools de paquets (et cœurs par défaut)
+};
+
+std::vector<std::string> split_list(std::string_view text, char sep = ',') {
+    std::vector<std::string> items;
+    while (!text.empty()) {
+        std::size_t pos = text.find(sep);
+        std::string_view item = text.substr(0, pos);
+        if (!item.empty()) items.emplace_back(item);
+        if (pos == std::string_view::npos) break;
+        text.remove_prefix(pos + 1);
+    }
+    return items;
+}
+
+template<typename T>
+Result<T> parse_number(std::string_view text, std::string_view name) {
+    T value{};
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    if (ec != std::errc{} || end != text.data() + text.size()) {
+        return std::unexpected(std::format("Valeur invalide pour --{}: '{}'", name, text));
+    }
+    return value;
+}
+
+constexpr int MAX_CPUS = 1024;  // CPU_SETSIZE de glibc
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}, format de taskset et de /sys
+Result<std::vector<int>> parse_cpu_list(std::string_view text) {
+    std::vector<int> cpus;
+    for (const std::string &item : split_list(text)) {
+        std::string_view range = item;
+        std::size_t dash = range.find('-');
+        auto first = parse_number<int>(range.substr(0, dash), "cpus");
+        if (!first) return std::unexpected(first.error());
+        auto last = dash == std::string_view::npos ? first : parse_number<int>(range.substr(dash + 1), "cpus");
+        if (!last) return std::unexpected(last.error());
+        if (*first < 0 || *last < *first || *last >= MAX_CPUS) {
+            return std::unexpected(std::format("Plage de cœurs invalide: '{}'", item));
+        }
+        for (int cpu = *first; cpu <= *last; cpu++) cpus.push_back(cpu);
+    }
+    std::ranges::sort(cpus);
+    cpus.erase(std::ranges::unique(cpus).begin(), cpus.end());
+    return cpus;
+}
+
+// Placement des étages du pipeline sur les cœurs du job. Avec au moins trois
+// cœurs, le lecteur et le muxer ont chacun le leur et les écrivains (index,
+// cache) se partagent le reste; sinon tous les étages partagent l'ensemble.
+// Les threads non placés (vignettes, renditions) héritent de l'ensemble.
+enum class PipelineStage { Reader, Muxer, Writer };
+
+struct CpuPlacement {
+    std::vector<int> cpus;
+
+    static CpuPlacement &instance() {
+        static CpuPlacement placement;
+        return placement;
+    }
+
+    [[nodiscard]] std::vector<int> stage_cpus(PipelineStage stage) const {
+        if (cpus.size() < 3) return cpus;
+        switch (stage) {
+            case PipelineStage::Reader: return {cpus[0]};
+            case PipelineStage::Muxer: return {cpus[1]};
+            case PipelineStage::Writer: break;
+        }
+        return {cpus.begin() + 2, cpus.end()};
+    }
+};
+
+#ifdef __linux__
+// ensemble de cœurs du thread courant (0 = appelant pour sched_setaffinity)
+Result<void> set_thread_cpus(const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+        return std::unexpected(std::format("sched_setaffinity impossible: {}", std::strerror(errno)));
+    }
+    return {};
+}
+
+// cœurs d'un nœud NUMA d'après /sys
+Result<std::vector<int>> numa_node_cpus(int node) {
+    std::string path = std::format("/sys/devices/system/node/node{}/cpulist", node);
+    std::ifstream file(path);
+    std::string list;
+    if (!file || !(file >> list)) {
+        return std::unexpected(std::format("Nœud NUMA {} introuvable ({})", node, path));
+    }
+    return parse_cpu_list(list);
+}
+#endif
+
+// place le thread courant pour la durée d'un bloc, puis rend son masque
+struct StagePin {
+#ifdef __linux__
+    cpu_set_t previous{};
+    bool pinned = false;
+
+    explicit StagePin(PipelineStage stage) {
+        std::vector<int> cpus = CpuPlacement::instance().stage_cpus(stage);
+        if (cpus.empty() || sched_getaffinity(0, sizeof(previous), &previous) != 0) return;
+        pinned = static_cast<bool>(set_thread_cpus(cpus));
+    }
+    ~StagePin() {
+        if (pinned) sched_setaffinity(0, sizeof(previous), &previous);
+    }
+#else
+    explicit StagePin(PipelineStage) {}
+#endif
+    StagePin(const StagePin &) = delete;
+    StagePin &operator=(const StagePin &) = delete;
+};
+
+// nom temporaire propre au processus et à l'appel : deux segmenteurs (ou deux
+// threads) qui publient le même fichier n'écrivent jamais le même .tmp
+std::string unique_tmp_path(const std::string &path) {
+    static std::atomic<uint64_t> counter{0};
+    return std::format("{}.{}.{}.tmp", path, getpid(), counter++);
+}
+
+// rename qui échoue (EEXIST) si la cible existe déjà
+Result<void> rename_noreplace(const std::string &from, const std::string &to) {
+#if defined(__linux__) && defined(RENAME_NOREPLACE)
+    if (renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0) return {};
+    if (errno != EINVAL && errno != ENOSYS) {
+        return std::unexpected(std::format("Impossible de publier '{}': {}", to, std::strerror(errno)));
+    }
+#endif
+    // système de fichiers sans renameat2 : link() échoue aussi si la cible existe
+    if (link(from.c_str(), to.c_str()) != 0) {
+        return std::unexpected(std::format("Impossible de publier '{}': {}", to, std::strerror(errno)));
+    }
+    unlink(from.c_str());
+    return {};
+}
+
+// Lecture d'un flux non seekable (stdin, pipe, FIFO) via un AVIOContext maison :
+// le segmenteur démarre dès les premiers octets, sans fichier temporaire.
+// En mode suivi, une fin de fichier n'est pas un EOF : on attend IN_MODIFY et on
+// relit, jusqu'au marqueur de fin ou au délai d'inactivité.
+struct InputReader {
+    int fd = -1;
+    bool owns_fd = false;
+    AVIOContext *pb = nullptr;
+    std::optional<FollowOptions> follow;
+    int inotify_fd = -1;
+    AVIOInterruptCB interrupt{};  // vérifié entre deux attentes bornées
+
+    InputReader() = default;
+    ~InputReader() {
+        if (pb) {
+            av_freep(&pb->buffer);
+            avio_context_free(&pb);
+        }
+        if (owns_fd && fd >= 0) ::close(fd);
+        if (inotify_fd >= 0) ::close(inotify_fd);
+    }
+    InputReader(const InputReader &) = delete;
+    InputReader &operator=(const InputReader &) = delete;
+
+    [[nodiscard]] bool interrupted() const {
+        return interrupt.callback && interrupt.callback(interrupt.opaque);
+    }
+
+    // attend une écriture sur le fichier (ou au plus timeout_ms)
+    void wait_growth(int timeout_ms) const {
+        if (inotify_fd < 0) {
+            poll(nullptr, 0, timeout_ms);
+            return;
+        }
+        pollfd pfd{inotify_fd, POLLIN, 0};
+        if (poll(&pfd, 1, timeout_ms) > 0) {
+            char events[4096];
+            while (read(inotify_fd, events, sizeof(events)) > 0) {}
+        }
+    }
+
+    int read_follow(uint8_t *buf, int size) {
+        auto idle_since = std::chrono::steady_clock::now();
+        bool marker_seen = false;
+        for (;;) {
+            ssize_t n = read(fd, buf, size);
+            if (n > 0) return static_cast<int>(n);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                return AVERROR(errno);
+            }
+            // relu une dernière fois après le marqueur : plus rien à venir
+            if (marker_seen) return AVERROR_EOF;
+            std::error_code ec;
+            if (!follow->done_marker.empty() && fs::exists(follow->done_marker, ec)) {
+                marker_seen = true;
+                continue;
+            }
+            double idle = std::chrono::duration<double>(std::chrono::steady_clock::now() - idle_since).count();
+            if (idle >= follow->idle_timeout) return AVERROR_EOF;
+            if (interrupted()) return AVERROR_EXIT;
+            wait_growth(static_cast<int>(std::min(500.0, (follow->idle_timeout - idle) * 1000.0)) + 1);
+        }
+    }
+
+    static int read_packet(void *opaque, uint8_t *buf, int size) {
+        auto *r = static_cast<InputReader *>(opaque);
+        if (r->follow) return r->read_follow(buf, size);
+        for (;;) {
+            // attente bornée : un pipe muet reste interruptible
+            pollfd pfd{r->fd, POLLIN, 0};
+            if (r->interrupt.callback && poll(&pfd, 1, 500) == 0) {
+                if (r->interrupted()) return AVERROR_EXIT;
+                continue;
+            }
+            ssize_t n = read(r->fd, buf, size);
+            if (n > 0) return static_cast<int>(n);
+            if (n == 0) return AVERROR_EOF;
+            if (errno != EINTR) return AVERROR(errno);
+        }
+    }
+
+    static Result<std::unique_ptr<InputReader>> create(int fd, bool owns_fd) {
+        auto reader = std::make_unique<InputReader>();
+        reader->fd = fd;
+        reader->owns_fd = owns_fd;
+
+        auto *buffer = static_cast<unsigned char *>(av_malloc(INPUT_AVIO_BUFFER_SIZE));
+        if (buffer) {
+            reader->pb = avio_alloc_context(buffer, static_cast<int>(INPUT_AVIO_BUFFER_SIZE), 0, reader.get(),
+                                            read_packet, nullptr, nullptr);
+            if (!reader->pb) av_free(buffer);
+        }
+        if (!reader->pb) {
+            return std::unexpected("Impossible d'allouer le contexte AVIO d'entrée");
+        }
+        reader->pb->seekable = 0;
+        return reader;
+    }
+};
+
+// "-" = stdin, "pipe:N" = fd N, sinon FIFO éventuelle; -1 pour un fichier normal
+Result<int> stream_input_fd(const std::string &path, bool &owns_fd) {
+    owns_fd = false;
+    if (path == "-") return STDIN_FILENO;
+    if (path.starts_with("pipe:")) return parse_number<int>(std::string_view(path).substr(5), "input");
+
+    struct stat st{};
+    if (stat(path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode)) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", path, std::strerror(errno)));
+        }
+        owns_fd = true;
+        return fd;
+    }
+    return -1;
+}
+
+// entrée relisable après un blocage : ni stdin, ni pipe:N, ni FIFO
+bool replayable_input(const std::string &path) {
+    if (path == "-" || path.starts_with("pipe:")) return false;
+    struct stat st{};
+    return !(stat(path.c_str(), &st) == 0 && S_ISFIFO(st.st_mode));
+}
+
 // Wrappers RAII FFMPEG
 struct AVInputGuard {
     AVFormatContext *ctx = nullptr;
+    std::unique_ptr<InputReader> reader;  // détruit après ctx
     AVInputGuard() = default;
     ~AVInputGuard() {
         if (ctx) avformat_close_input(&ctx);
     }
     AVInputGuard(const AVInputGuard &) = delete;
     AVInputGuard &operator=(const AVInputGuard &) = delete;
-    AVInputGuard(AVInputGuard &&other) noexcept : ctx(other.ctx) {
+    AVInputGuard(AVInputGuard &&other) noexcept : ctx(other.ctx), reader(std::move(other.reader)) {
         other.ctx = nullptr;
     }
     AVInputGuard &operator=(AVInputGuard &&other) noexcept {
@@ -56,15 +440,64 @@ struct AVInputGuard {
             if (ctx) avformat_close_input(&ctx);
             ctx = other.ctx;
             other.ctx = nullptr;
+            reader = std::move(other.reader);
         }
         return *this;
     }
 
     [[nodiscard]] bool is_open() const { return ctx != nullptr; }
 
-    static Result<AVInputGuard> open(const std::string &path) {
+    static Result<AVInputGuard> open(const std::string &path, const std::string &format_name = {},
+                                     const std::optional<FollowOptions> &follow = std::nullopt,
+                                     const AVIOInterruptCB *interrupt = nullptr) {
         AVInputGuard guard;
-        int ret = avformat_open_input(&guard.ctx, path.c_str(), nullptr, nullptr);
+
+        const AVInputFormat *format = nullptr;
+        if (!format_name.empty() && !(format = av_find_input_format(format_name.c_str()))) {
+            return std::unexpected(std::format("Format d'entrée inconnu '{}'", format_name));
+        }
+
+        bool owns_fd = false;
+        auto fd = stream_input_fd(path, owns_fd);
+        if (!fd) return std::unexpected(fd.error());
+        if (*fd < 0 && follow) {
+            fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (*fd < 0) {
+                return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", path, std::strerror(errno)));
+            }
+            owns_fd = true;
+        }
+        if (*fd >= 0) {
+            auto reader = InputReader::create(*fd, owns_fd);
+            if (!reader) return std::unexpected(reader.error());
+            guard.reader = std::move(*reader);
+            if (interrupt) guard.reader->interrupt = *interrupt;
+            if (follow) {
+                guard.reader->follow = follow;
+#ifdef __linux__
+                guard.reader->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                if (guard.reader->inotify_fd >= 0 &&
+                    inotify_add_watch(guard.reader->inotify_fd, path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+                    ::close(guard.reader->inotify_fd);
+                    guard.reader->inotify_fd = -1;
+                }
+#endif
+            }
+
+            guard.ctx = avformat_alloc_context();
+            if (!guard.ctx) return std::unexpected("Impossible d'allouer le ctx d'entrée");
+            guard.ctx->pb = guard.reader->pb;
+            guard.ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+        // doit précéder avformat_open_input : l'AVIOContext le recopie à l'ouverture
+        if (interrupt) {
+            if (!guard.ctx && !(guard.ctx = avformat_alloc_context())) {
+                return std::unexpected("Impossible d'allouer le ctx d'entrée");
+            }
+            guard.ctx->interrupt_callback = *interrupt;
+        }
+
+        int ret = avformat_open_input(&guard.ctx, path.c_str(), format, nullptr);
 
         if (ret < 0) {
             char errbuf[FF_INPUT_BUF_SIZE];
@@ -82,7 +515,7 @@ struct AVOutputGuard {
     AVFormatContext *ctx = nullptr;
     AVOutputGuard() = default;
     ~AVOutputGuard() {
-        if (ctx) return;
+        if (!ctx) return;
         if (ctx->pb) avio_close(ctx->pb);
         avformat_free_context(ctx);
     }
@@ -163,25 +596,33 @@ struct PacketQueue {
     std::condition_variable cv;
     bool closed = false; // flag
     const std::size_t capacity; // size max queue
+    std::size_t bytes = 0;      // payloads en file
+    std::size_t max_bytes = 0;  // 0 = pas de budget en octets; réglable en cours de route
 
-    explicit PacketQueue(std::size_t cap) : capacity(cap) {}
+    explicit PacketQueue(std::size_t cap, std::size_t max_bytes = 0) : capacity(cap), max_bytes(max_bytes) {}
 
     PacketQueue(const PacketQueue &) = delete;
     PacketQueue &operator=(const PacketQueue &) = delete;
 
-    void push (AVPacket *pkt) {
+    // false si la file est fermée (le paquet est alors libéré)
+    bool push (AVPacket *pkt) {
         {
             std::unique_lock lock(mtx);
-            cv.wait(lock, [this] {
-                return buffer.size() < capacity || closed;
+            std::size_t size = static_cast<std::size_t>(std::max(pkt->size, 0));
+            // un paquet seul passe toujours, même plus gros que le budget
+            cv.wait(lock, [&] {
+                return (buffer.size() < capacity &&
+                        (max_bytes == 0 || buffer.empty() || bytes + size <= max_bytes)) || closed;
             });
             if (closed) {
-                av_packet_free(pkt);
-                return;
+                av_packet_free(&pkt);
+                return false;
             }
             buffer.push(pkt);
+            bytes += size;
         }
         cv.notify_one();
+        return true;
     }
 
     [[nodiscard]] AVPacket *pop() {
@@ -195,6 +636,27 @@ struct PacketQueue {
 
         AVPacket *pkt = buffer.front();
         buffer.pop();
+        bytes -= static_cast<std::size_t>(std::max(pkt->size, 0));
+
+        lock.unlock();
+        cv.notify_one();
+
+        return pkt;
+    }
+
+    // comme pop, mais nullptr après timeout sans paquet (timed_out = true)
+    [[nodiscard]] AVPacket *pop_for(std::chrono::duration<double> timeout, bool &timed_out) {
+        std::unique_lock lock(mtx);
+
+        timed_out = !cv.wait_for(lock, timeout, [this] {
+            return !buffer.empty() || closed;
+        });
+
+        if (buffer.empty()) return nullptr;
+
+        AVPacket *pkt = buffer.front();
+        buffer.pop();
+        bytes -= static_cast<std::size_t>(std::max(pkt->size, 0));
 
         lock.unlock();
         cv.notify_one();
@@ -208,455 +670,5082 @@ struct PacketQueue {
         }
         cv.notify_all();
     }
+    void set_max_bytes(std::size_t limit) {
+        {
+            std::unique_lock lock(mtx);
+            max_bytes = limit;
+        }
+        cv.notify_all();
+    }
     [[nodiscard]] std::size_t size() {
         std::unique_lock lock(mtx);
         return buffer.size();
     }
+    [[nodiscard]] std::size_t queued_bytes() {
+        std::unique_lock lock(mtx);
+        return bytes;
+    }
 };
 
-Result<AVStream *>add_out_stream(AVFormatContext *output_ctx, AVStream *in_stream) {
-    AVStream *out_stream = avformat_new_stream(output_ctx, nullptr);
+// Pool de buffers pour les payloads de paquets.
+// Des chunks de 2 Mo (huge pages si dispo) sont découpés en blocs par classe
+// de taille (1 Ko .. 2 Mo); chaque thread garde un petit cache par classe et
+// échange des lots avec le dépôt global (le lecteur alloue, le muxer libère).
+// Un chunk dont tous les blocs sont revenus au dépôt est rendu au système au-delà
+// de POOL_DEPOT_SLACK chunks libres par classe; au-delà de POOL_MAX_BYTES, les
+// allocations sortent du pool.
+constexpr std::size_t POOL_CHUNK_SIZE = 2 * 1024 * 1024;
+constexpr std::size_t POOL_MIN_BLOCK_SHIFT = 10;
+constexpr std::size_t POOL_NUM_CLASSES = 12;
+constexpr std::size_t POOL_THREAD_CACHE = 32;               // blocs par classe et par thread
+constexpr std::size_t POOL_THREAD_CACHE_BYTES = 256 * 1024;  // ... dans cette limite d'octets
+constexpr std::size_t POOL_DEPOT_SLACK = 2;
+constexpr std::size_t POOL_MAX_BYTES = 256 * 1024 * 1024;
 
-    if (!out_stream) {
-        return std::unexpected("Impossible d'allouer le flux de sortie");
-    }
+struct PacketBufferPool {
+    struct ChunkState {
+        std::size_t in_depot = 0;  // blocs du chunk présents dans le dépôt
+        bool huge = false;
+    };
 
-    // copy param codec
-    if (avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar) < 0) {
-        return std::unexpected("Impossible de copier les paramètres du codec");
-    }
+    struct SizeClass {
+        PacketBufferPool *pool = nullptr;
+        std::size_t index = 0;
+        std::size_t block_size = 0;
+        std::size_t blocks_per_chunk = 0;
+        std::size_t cache_limit = 0;  // blocs gardés par thread
+        std::size_t batch = 0;        // blocs échangés avec le dépôt d'un coup
+        std::mutex mtx;
+        std::vector<uint8_t *> depot;
+        std::map<uintptr_t, ChunkState> chunks;  // base alignée sur POOL_CHUNK_SIZE
+    };
 
-    out_stream->codecpar->codec_tag = 0;
-    out_stream->time_base = in_stream->time_base;
-    return out_stream;
-}
+    struct ThreadCache {
+        // trivial, donc lisible même après la destruction du cache en fin de thread
+        enum class State : uint8_t { Fresh, Alive, Dead };
+        static inline thread_local State state = State::Fresh;
 
-Result<void>write_idx_file(
-    const std::string &index_path,
-    const std::string &tmp_path,
-    const std::vector<unsigned int> &durations,
-    unsigned int offset,
-    const std::string &prefix,
-    const std::string &ext,
-    unsigned int max_duration,
-    bool islast
-) {
+        std::array<std::vector<uint8_t *>, POOL_NUM_CLASSES> blocks{};
+        ThreadCache() { state = State::Alive; }
+        ~ThreadCache() {
+            state = State::Dead;
+            PacketBufferPool &pool = PacketBufferPool::instance();
+            for (std::size_t c = 0; c < POOL_NUM_CLASSES; c++)
+                pool.give_back(c, blocks[c], blocks[c].size());
+        }
+    };
 
-    if (durations.empty()) {
-        return {};
+    std::array<SizeClass, POOL_NUM_CLASSES> classes{};
+    std::atomic<std::size_t> huge_chunks{0};
+    std::atomic<std::size_t> normal_chunks{0};
+    std::atomic<std::size_t> released_chunks{0};
+    std::atomic<std::size_t> fallback_allocs{0};
+    std::atomic<std::size_t> copied_packets{0};
+    int numa_node = -1;  // fixé avant la première allocation
+
+    PacketBufferPool() {
+        for (std::size_t c = 0; c < POOL_NUM_CLASSES; c++) {
+            classes[c].pool = this;
+            classes[c].index = c;
+            classes[c].block_size = std::size_t{1} << (POOL_MIN_BLOCK_SHIFT + c);
+            classes[c].blocks_per_chunk = POOL_CHUNK_SIZE / classes[c].block_size;
+            classes[c].cache_limit = std::clamp<std::size_t>(POOL_THREAD_CACHE_BYTES / classes[c].block_size,
+                                                             1, POOL_THREAD_CACHE);
+            classes[c].batch = std::max<std::size_t>(classes[c].cache_limit / 2, 1);
+        }
+    }
+    ~PacketBufferPool() {
+        for (SizeClass &cls : classes) {
+            for (const auto &[base, chunk] : cls.chunks) munmap(reinterpret_cast<void *>(base), POOL_CHUNK_SIZE);
+        }
     }
+    PacketBufferPool(const PacketBufferPool &) = delete;
+    PacketBufferPool &operator=(const PacketBufferPool &) = delete;
 
-    FILE *fp = fopen(tmp_path.c_str(), "w");
-    if (!fp) {
-        return std::unexpected(std::format("Erreur: Impossible d'ouvrir '%s' pour écriture: %s\n", tmp_path, std::strerror(errno)));
+    static PacketBufferPool &instance() {
+        static PacketBufferPool pool;
+        return pool;
     }
 
-    std::print(fp, "#EXTM3U\n#EXT-X-VERSION:3\n"
-                    "#EXT-X-MEDIA-SEQUENCE:{}\n#EXT-X-TARGETDURATION:{}\n",
-               offset, max_duration);
+    // nullptr une fois le cache du thread détruit : on passe alors par le dépôt
+    static ThreadCache *thread_cache() {
+        if (ThreadCache::state == ThreadCache::State::Dead) return nullptr;
+        thread_local ThreadCache cache;
+        return &cache;
+    }
 
-    for (std::size_t i = 0; i < durations.size(); i++) {
-        std::print(fp, "#EXTINF:{},\n{}-{}{}\n",
-                   durations[i], prefix, i + offset, ext);
+    static uintptr_t chunk_of(const uint8_t *block) {
+        return reinterpret_cast<uintptr_t>(block) & ~(uintptr_t{POOL_CHUNK_SIZE} - 1);
     }
 
-    if (islast) std::print(fp, "#EXT-X-ENDLIST\n");
+    // préférence (et non obligation) pour le nœud du job, avant le premier accès
+    void bind_chunk(void *chunk) const {
+#if defined(__linux__) && defined(SYS_mbind)
+        if (numa_node < 0 || numa_node >= static_cast<int>(sizeof(unsigned long) * CHAR_BIT)) return;
+        unsigned long mask = 1UL << numa_node;
+        syscall(SYS_mbind, chunk, POOL_CHUNK_SIZE, MPOL_PREFERRED, &mask, sizeof(mask) * CHAR_BIT, 0);
+#else
+        (void)chunk;
+#endif
+    }
 
-    fclose(fp);
+    // chunk de 2 Mo aligné : MAP_HUGETLB sinon THP (madvise) sinon pages normales
+    void *map_chunk(bool &huge) {
+#ifdef MAP_HUGETLB
+        void *hp = mmap(nullptr, POOL_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (hp != MAP_FAILED) {
+            bind_chunk(hp);
+            huge = true;
+            return hp;
+        }
+#endif
+        void *raw = mmap(nullptr, 2 * POOL_CHUNK_SIZE, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (raw == MAP_FAILED) return nullptr;
 
-    if (std::error_code ec; !fs::exists(tmp_path) ||
-        (fs::rename(tmp_path,index_path, ec), ec)) {
-        return std::expected(std::format("Impossible de renommer '{}' vers '{}'", tmp_path, index_path));
+        auto addr = reinterpret_cast<uintptr_t>(raw);
+        uintptr_t aligned = (addr + POOL_CHUNK_SIZE - 1) & ~(uintptr_t{POOL_CHUNK_SIZE} - 1);
+        if (aligned > addr) munmap(raw, aligned - addr);
+        uintptr_t tail = aligned + POOL_CHUNK_SIZE;
+        uintptr_t end = addr + 2 * POOL_CHUNK_SIZE;
+        if (end > tail) munmap(reinterpret_cast<void *>(tail), end - tail);
+
+        void *p = reinterpret_cast<void *>(aligned);
+#ifdef MADV_HUGEPAGE
+        madvise(p, POOL_CHUNK_SIZE, MADV_HUGEPAGE);
+#endif
+        bind_chunk(p);
+        huge = false;
+        return p;
     }
 
-    return {};
-}
+    // remplit le dépôt d'une classe avec un nouveau chunk (verrou de classe tenu)
+    bool grow(SizeClass &cls) {
+        if (reserved_bytes() + POOL_CHUNK_SIZE > POOL_MAX_BYTES) return false;
+        bool huge = false;
+        void *chunk = map_chunk(huge);
+        if (!chunk) return false;
+        (huge ? huge_chunks : normal_chunks)++;
+        auto *base = static_cast<uint8_t *>(chunk);
+        for (std::size_t off = 0; off + cls.block_size <= POOL_CHUNK_SIZE; off += cls.block_size)
+            cls.depot.push_back(base + off);
+        cls.chunks[reinterpret_cast<uintptr_t>(chunk)] = ChunkState{cls.blocks_per_chunk, huge};
+        return true;
+    }
 
-Result<std::string> open_next_segment(
-    AVFormatContext *output_ctx,
-    const std::string &dir,
-    const std::string &name,
-    unsigned int idx,
-    const std::string &ext
-) {
-    std::string filename = std::format("{}/{}-{}{}", dir, name, idx, ext);
+    // rend au système les chunks entièrement libres au-delà de la réserve (verrou de classe tenu)
+    void trim(SizeClass &cls) {
+        std::size_t slack = POOL_DEPOT_SLACK * cls.blocks_per_chunk;
+        for (auto it = cls.chunks.begin(); it != cls.chunks.end() && cls.depot.size() > slack;) {
+            if (it->second.in_depot != cls.blocks_per_chunk) {
+                ++it;
+                continue;
+            }
+            uintptr_t base = it->first;
+            std::erase_if(cls.depot, [base](const uint8_t *block) { return chunk_of(block) == base; });
+            munmap(reinterpret_cast<void *>(base), POOL_CHUNK_SIZE);
+            (it->second.huge ? huge_chunks : normal_chunks)--;
+            released_chunks++;
+            it = cls.chunks.erase(it);
+        }
+    }
 
-    if (avio_open(&output_ctx->pb, filename.c_str(), AVIO_FLAG_WRITE) < 0)
-    return std::unexpected(std::format("Impossible d'ouvrir '{}'", filename));
+    void give_back(std::size_t c, std::vector<uint8_t *> &local, std::size_t count) {
+        if (count == 0) return;
+        SizeClass &cls = classes[c];
+        std::unique_lock lock(cls.mtx);
+        for (auto it = local.end() - count; it != local.end(); ++it) cls.chunks[chunk_of(*it)].in_depot++;
+        cls.depot.insert(cls.depot.end(), local.end() - count, local.end());
+        local.resize(local.size() - count);
+        if (cls.depot.size() > POOL_DEPOT_SLACK * cls.blocks_per_chunk) trim(cls);
+    }
 
-    std::println("Segment : '{}'", filename);
-    return filename;
-}
+    // n blocs du dépôt vers out (verrou de classe tenu)
+    void take_from_depot(SizeClass &cls, std::vector<uint8_t *> &out, std::size_t n) {
+        n = std::min(cls.depot.size(), n);
+        for (auto it = cls.depot.end() - n; it != cls.depot.end(); ++it) cls.chunks[chunk_of(*it)].in_depot--;
+        out.insert(out.end(), cls.depot.end() - n, cls.depot.end());
+        cls.depot.resize(cls.depot.size() - n);
+    }
 
-void thread_reader(
-    AVFormatContext *input_ctx,
-    int in_video_idx,
-    int in_audio_idx,
-    PacketQueue &queue
-    ) {
-    auto pkt_result = AVPacketGuard::create("mpegts");
-    if (!pkt_result) {
-        std::println(stderr, "[Lecteur] Erreur: {}", pkt_result.error());
-        queue.close();
-        return;
+    uint8_t *take_block(std::size_t c) {
+        SizeClass &cls = classes[c];
+        ThreadCache *tc = thread_cache();
+        if (!tc) {
+            std::vector<uint8_t *> one;
+            std::unique_lock lock(cls.mtx);
+            if (cls.depot.empty() && !grow(cls)) return nullptr;
+            take_from_depot(cls, one, 1);
+            return one.back();
+        }
+        std::vector<uint8_t *> &local = tc->blocks[c];
+        if (local.empty()) {
+            std::unique_lock lock(cls.mtx);
+            if (cls.depot.empty() && !grow(cls)) return nullptr;
+            take_from_depot(cls, local, cls.batch);
+        }
+        uint8_t *block = local.back();
+        local.pop_back();
+        return block;
     }
-    AVPacketGuard pkt = std::move(*pkt_result);
 
-    while (av_read_frame(input_ctx, pkt) >= 0) {
-        bool is_video = (pkt->stream_index == in_video_idx);
-        bool is_audio = (pkt->stream_index == in_audio_idx);
+    static void free_block(void *opaque, uint8_t *data) {
+        auto *cls = static_cast<SizeClass *>(opaque);
+        ThreadCache *tc = thread_cache();
+        if (!tc) {
+            std::vector<uint8_t *> one{data};
+            cls->pool->give_back(cls->index, one, 1);
+            return;
+        }
+        std::vector<uint8_t *> &local = tc->blocks[cls->index];
+        local.push_back(data);
+        if (local.size() > cls->cache_limit)
+            cls->pool->give_back(cls->index, local, cls->batch);
+    }
 
-        if (!is_video && !is_audio) {
-            av_packet_unref(pkt);
-            continue;
+    [[nodiscard]] AVBufferRef *acquire(std::size_t size) {
+        for (std::size_t c = 0; c < POOL_NUM_CLASSES; c++) {
+            SizeClass &cls = classes[c];
+            if (cls.block_size < size) continue;
+
+            uint8_t *block = take_block(c);
+            if (!block) break;
+            AVBufferRef *buf = av_buffer_create(block, cls.block_size, free_block, &cls, 0);
+            if (!buf) free_block(&cls, block);
+            return buf;
         }
+        fallback_allocs++;
+        return av_buffer_alloc(size);
+    }
 
-        auto copy_result = AVPacketGuard::create("mpegts");
-        if (!copy_result) {
-            std::println(stderr, "[Lecteur] Erreur: {}", copy_result.error());
-            av_packet_unref(pkt);
-            break;
+    // paquet démuxé à garder au-delà du prochain av_read_frame : un payload déjà
+    // compté par référence est simplement partagé, seul un payload non compté
+    // (propriété du démuxeur) est recopié dans un bloc du pool
+    [[nodiscard]] Result<AVPacket *> copy_packet(const AVPacket *src) {
+        AVPacketGuard dst;
+        if (!dst) {
+            return std::unexpected("Impossible d'allouer AVPacket");
         }
-        AVPacketGuard copy = std::move(*pkt);
-        if (av_packet_ref(copy, pkt) < 0) {
-            std::println(stderr, "[Lecteur] Erreur: av_packet_ref failed");
-            av_packet_unref(pkt);
-            break;
+        if (src->buf) {
+            if (av_packet_ref(dst, src) < 0) {
+                return std::unexpected("Impossible de référencer le paquet");
+            }
+            return dst.release();
         }
-        AVPacket *raw = copy.pkt;
-        copy.pkt = nullptr;
 
-        queue.push(raw);
+        AVBufferRef *buf = acquire(src->size + AV_INPUT_BUFFER_PADDING_SIZE);
+        if (!buf) {
+            return std::unexpected(std::format("Impossible d'allouer {} octets dans le pool", src->size));
+        }
+        std::memcpy(buf->data, src->data, src->size);
+        std::memset(buf->data + src->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+        dst->buf = buf;
+        dst->data = buf->data;
+        dst->size = src->size;
+        copied_packets++;
 
-        av_packet_unref(raw);
+        if (av_packet_copy_props(dst, src) < 0) {
+            return std::unexpected("Impossible de copier les propriétés du paquet");
+        }
+        return dst.release();
     }
-    queue.close();
-    std::println("[Lecteur] Terminé");
-}
 
-// IdxTask + IdxQueue
-struct IdxTask {
-    std::string idx_path;
-    std::string tmp_path;
-    std::string prefix;
-    std::string ext;
-    std::vector<unsigned int> durations;
-    unsigned int offset = 0;
-    unsigned int max_duration = 0;
-    bool islast = false;
-    std::string old_filename;
+    [[nodiscard]] std::size_t reserved_bytes() const {
+        return (huge_chunks + normal_chunks) * POOL_CHUNK_SIZE;
+    }
 };
 
-struct IdxQueue {
-    std::queue<IdxTask *> tasks;
-    std::mutex mtx;
-    std::condition_variable cv;
-    bool closed = false;
+Result<AVStream *>add_out_stream(AVFormatContext *output_ctx, AVStream *in_stream) {
+    AVStream *out_stream = avformat_new_stream(output_ctx, nullptr);
 
-    IdxQueue() = default;
-    IdxQueue(const IdxQueue &) = delete;
-    IdxQueue &operator=(const IdxQueue &) = delete;
+    if (!out_stream) {
+        return std::unexpected("Impossible d'allouer le flux de sortie");
+    }
 
-    void push (IdxTask *task) {
-        {
-            std::unique_lock lock(mtx);
-            tasks.push(std::move(task));
-        }
-        cv.notify_one();
+    // copy param codec
+    if (avcodec_parameters_copy(out_stream->codecpar, in_stream->codecpar) < 0) {
+        return std::unexpected("Impossible de copier les paramètres du codec");
     }
 
-    [[nodiscard]] std::optional<IdxTask> pop () {
-        std::unique_lock lock(mtx);
+    out_stream->codecpar->codec_tag = 0;
+    out_stream->time_base = in_stream->time_base;
+    return out_stream;
+}
 
-        cv.wait(lock, [this] {
-            return !tasks.empty() || closed;
-        });
+// détecte le premier flux vidéo et le premier flux audio
+void find_av_streams(const AVFormatContext *ctx, int &video_idx, int &audio_idx) {
+    video_idx = -1;
+    audio_idx = -1;
+    for (unsigned int i = 0; i < ctx->nb_streams; i++) {
+        AVMediaType type = ctx->streams[i]->codecpar->codec_type;
+        if (type == AVMEDIA_TYPE_VIDEO && video_idx < 0) video_idx = static_cast<int>(i);
+        if (type == AVMEDIA_TYPE_AUDIO && audio_idx < 0) audio_idx = static_cast<int>(i);
+    }
+}
 
-        if (tasks.empty()) {
-            return std::nullopt;
-        }
+// Horodatage d'arrivée d'un paquet (lecture par thread_reader), porté par
+// AVPacket::opaque en ns d'horloge monotone. 0 = non horodaté.
+// av_packet_copy_props ne recopie opaque que selon la version de FFmpeg :
+// toute duplication d'un paquet horodaté passe par copy_arrival.
+int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void stamp_arrival(AVPacket *pkt, int64_t ns) {
+    pkt->opaque = reinterpret_cast<void *>(static_cast<intptr_t>(ns));
+}
+
+int64_t packet_arrival(const AVPacket *pkt) {
+    return static_cast<int64_t>(reinterpret_cast<intptr_t>(pkt->opaque));
+}
+
+AVPacket *copy_arrival(AVPacket *dst, const AVPacket *src) {
+    if (dst) stamp_arrival(dst, packet_arrival(src));
+    return dst;
+}
+
+// Dump d'état à la demande (SIGUSR1) : chaque thread du pipeline s'inscrit et
+// signale s'il travaille, attend une file ou est bloqué en I/O ; le muxer publie
+// sa progression en atomiques. Le thread de signaux écrit un instantané sans
+// rien arrêter (StatusBoard::dump, plus bas).
+enum class ThreadActivity { Working, Waiting, BlockedIo, Done };
+
+struct ThreadStatus {
+    std::string name;
+    std::atomic<ThreadActivity> activity{ThreadActivity::Working};
+    std::atomic<int64_t> since_ns{0};
+
+    void set(ThreadActivity a) {
+        activity.store(a, std::memory_order_relaxed);
+        since_ns.store(monotonic_ns(), std::memory_order_relaxed);
+    }
+};
+
+struct PacketQueue;
+struct IdxQueue;
+struct WriteBehindCache;
+
+struct StatusBoard {
+    std::mutex mtx;
+    std::deque<ThreadStatus> threads;  // adresses stables, emplacements Done réutilisés
+    std::string path;
+    std::string input;
+    std::string last_error;
+    PacketQueue *packets = nullptr;
+    IdxQueue *index = nullptr;
+    WriteBehindCache *cache = nullptr;
+    const int64_t started_ns = monotonic_ns();
+    uint64_t dumps = 0;
+
+    // progression du muxer
+    std::atomic<unsigned int> segment{0};
+    std::atomic<int64_t> segment_opened_ns{0};
+    std::atomic<double> segment_media{0.0};
+    std::atomic<uint64_t> interleaver_bytes{0};
+    std::atomic<uint64_t> segment_pending_bytes{0};
+    std::atomic<uint64_t> packets_muxed{0};
+    std::atomic<unsigned int> budget_percent{100};
+
+    static inline thread_local ThreadStatus *current = nullptr;
+
+    static StatusBoard &instance() {
+        static StatusBoard board;
+        return board;
+    }
+
+    void attach(const std::string &name) {
+        std::lock_guard lock(mtx);
+        auto free_slot = std::ranges::find_if(threads, [](const ThreadStatus &t) {
+            return t.activity.load() == ThreadActivity::Done;
+        });
+        ThreadStatus &slot = free_slot != threads.end() ? *free_slot : threads.emplace_back();
+        slot.name = name;
+        slot.set(ThreadActivity::Working);
+        current = &slot;
+    }
+
+    void detach() {
+        if (current) current->set(ThreadActivity::Done);
+        current = nullptr;
+    }
+
+    void set_error(const std::string &message) {
+        std::lock_guard lock(mtx);
+        last_error = message;
+    }
+
+    void watch(PacketQueue *p, IdxQueue *i, WriteBehindCache *c) {
+        std::lock_guard lock(mtx);
+        packets = p;
+        index = i;
+        cache = c;
+    }
+
+    void note_progress(unsigned int seg, double media, uint64_t interleaved, uint64_t pending) {
+        if (segment.exchange(seg, std::memory_order_relaxed) != seg) {
+            segment_opened_ns.store(monotonic_ns(), std::memory_order_relaxed);
+        }
+        segment_media.store(media, std::memory_order_relaxed);
+        interleaver_bytes.store(interleaved, std::memory_order_relaxed);
+        segment_pending_bytes.store(pending, std::memory_order_relaxed);
+        packets_muxed.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Result<void> dump();
+};
+
+// Profileur par échantillonnage (--profile). Chaque thread inscrit arme un timer
+// sur sa propre horloge CPU (timer_create + SIGEV_THREAD_ID) : un thread qui
+// attend ne coûte rien. Sur SIGPROF, le handler copie la pile (backtrace,
+// amorcé au démarrage pour ne pas charger libgcc en contexte de signal) dans un
+// anneau sans verrou; un thread de fond agrège les piles identiques. L'export
+// est au format replié de flamegraph.pl : "thread;appelant;...;appelé N".
+constexpr std::size_t PROFILE_MAX_DEPTH = 48;
+constexpr std::size_t PROFILE_RING_SIZE = 4096;
+constexpr std::size_t PROFILE_SKIP_FRAMES = 2;  // handler + trampoline de signal
+
+struct ProfileSample {
+    std::atomic<bool> ready{false};
+    int thread = 0;
+    int depth = 0;
+    void *pcs[PROFILE_MAX_DEPTH];
+};
+
+struct SamplingProfiler {
+    std::atomic<bool> enabled{false};
+    std::string path;
+    unsigned int hz = 99;
+    std::unique_ptr<ProfileSample[]> ring;
+    std::atomic<uint64_t> head{0};
+    std::atomic<uint64_t> dropped{0};
+
+    std::mutex mtx;
+    std::vector<std::string> thread_names;           // index = ProfileSample::thread
+    std::map<std::vector<void *>, uint64_t> stacks;  // [thread, pc appelé, ..., pc racine]
+    uint64_t samples = 0;
+
+    std::thread aggregator;
+    std::mutex wake_mtx;
+    std::condition_variable wake;
+    bool stopping = false;
+
+#ifdef __linux__
+    static inline thread_local int thread_index = -1;
+    static inline thread_local timer_t timer{};
+#endif
+
+    static SamplingProfiler &instance() {
+        static SamplingProfiler profiler;
+        return profiler;
+    }
+
+#ifdef __linux__
+    static void on_sigprof(int, siginfo_t *, void *) {
+        int saved_errno = errno;
+        SamplingProfiler &p = instance();
+        if (thread_index >= 0 && p.enabled.load(std::memory_order_relaxed)) {
+            uint64_t slot = p.head.fetch_add(1, std::memory_order_relaxed) % PROFILE_RING_SIZE;
+            ProfileSample &sample = p.ring[slot];
+            if (sample.ready.load(std::memory_order_acquire)) {
+                p.dropped.fetch_add(1, std::memory_order_relaxed);  // agrégateur en retard
+            } else {
+                sample.thread = thread_index;
+                sample.depth = backtrace(sample.pcs, PROFILE_MAX_DEPTH);
+                sample.ready.store(true, std::memory_order_release);
+            }
+        }
+        errno = saved_errno;
+    }
+#endif
+
+    // avant la création des threads du pipeline
+    Result<void> start(const std::string &file, unsigned int rate) {
+#ifdef __linux__
+        path = file;
+        hz = std::clamp(rate, 1u, 1000u);
+        ring = std::make_unique<ProfileSample[]>(PROFILE_RING_SIZE);
+        void *prime[1];
+        backtrace(prime, 1);
+
+        struct sigaction action{};
+        action.sa_sigaction = on_sigprof;
+        action.sa_flags = SA_SIGINFO | SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        if (sigaction(SIGPROF, &action, nullptr) != 0) {
+            return std::unexpected(std::format("sigaction(SIGPROF) impossible: {}", std::strerror(errno)));
+        }
+        aggregator = std::thread([this] {
+            // SIGUSR1/SIGUSR2 vont au thread de signaux, jamais ici (action par défaut : fin du job)
+            sigset_t control;
+            sigemptyset(&control);
+            sigaddset(&control, SIGUSR1);
+            sigaddset(&control, SIGUSR2);
+            pthread_sigmask(SIG_BLOCK, &control, nullptr);
+            std::unique_lock lock(wake_mtx);
+            while (!stopping) {
+                wake.wait_for(lock, std::chrono::milliseconds(100));
+                collect();
+            }
+        });
+        enabled = true;
+        return {};
+#else
+        (void)file;
+        (void)rate;
+        return std::unexpected("--profile n'est disponible que sous Linux");
+#endif
+    }
+
+    void stop() {
+        if (!enabled.exchange(false)) return;
+        {
+            std::lock_guard lock(wake_mtx);
+            stopping = true;
+        }
+        wake.notify_all();
+        aggregator.join();
+    }
+
+    // inscrit le thread courant; les threads de même nom sont agrégés ensemble
+    void attach_thread(const std::string &name) {
+#ifdef __linux__
+        if (!enabled) return;
+        int index = 0;
+        {
+            std::lock_guard lock(mtx);
+            auto it = std::ranges::find(thread_names, name);
+            index = static_cast<int>(it - thread_names.begin());
+            if (it == thread_names.end()) thread_names.push_back(name);
+        }
+
+        clockid_t clock{};
+        if (pthread_getcpuclockid(pthread_self(), &clock) != 0) return;
+        sigevent event{};
+        event.sigev_notify = SIGEV_THREAD_ID;
+        event.sigev_signo = SIGPROF;
+#ifndef sigev_notify_thread_id
+        event._sigev_un._tid = static_cast<pid_t>(gettid());
+#else
+        event.sigev_notify_thread_id = static_cast<pid_t>(gettid());
+#endif
+        if (timer_create(clock, &event, &timer) != 0) return;
+
+        long period_ns = 1'000'000'000L / hz;
+        itimerspec spec{};
+        spec.it_value.tv_sec = spec.it_interval.tv_sec = period_ns / 1'000'000'000L;
+        spec.it_value.tv_nsec = spec.it_interval.tv_nsec = period_ns % 1'000'000'000L;
+        thread_index = index;
+        if (timer_settime(timer, 0, &spec, nullptr) != 0) {
+            thread_index = -1;
+            timer_delete(timer);
+        }
+#else
+        (void)name;
+#endif
+    }
+
+    void detach_thread() {
+#ifdef __linux__
+        if (thread_index < 0) return;
+        thread_index = -1;
+        timer_delete(timer);
+#endif
+    }
+
+    // vide l'anneau dans la table des piles
+    void collect() {
+        if (!ring) return;
+        std::lock_guard lock(mtx);
+        for (std::size_t i = 0; i < PROFILE_RING_SIZE; i++) {
+            ProfileSample &sample = ring[i];
+            if (!sample.ready.load(std::memory_order_acquire)) continue;
+            std::vector<void *> key;
+            key.reserve(static_cast<std::size_t>(sample.depth) + 1);
+            key.push_back(reinterpret_cast<void *>(static_cast<uintptr_t>(sample.thread)));
+            for (int f = static_cast<int>(PROFILE_SKIP_FRAMES); f < sample.depth; f++) key.push_back(sample.pcs[f]);
+            stacks[std::move(key)]++;
+            samples++;
+            sample.ready.store(false, std::memory_order_release);
+        }
+    }
+
+    Result<void> write();
+};
+
+// inscrit le thread courant pour sa durée de vie
+struct ThreadAttach {
+    explicit ThreadAttach(const std::string &name) {
+        StatusBoard::instance().attach(name);
+        SamplingProfiler::instance().attach_thread(name);
+    }
+    ~ThreadAttach() {
+        SamplingProfiler::instance().detach_thread();
+        StatusBoard::instance().detach();
+    }
+    ThreadAttach(const ThreadAttach &) = delete;
+    ThreadAttach &operator=(const ThreadAttach &) = delete;
+};
+
+// état du thread courant le temps d'un bloc (attente de file, appel bloquant)
+struct ActivityScope {
+    ThreadStatus *status = StatusBoard::current;
+    ThreadActivity previous = ThreadActivity::Working;
+
+    explicit ActivityScope(ThreadActivity activity) {
+        if (!status) return;
+        previous = status->activity.load(std::memory_order_relaxed);
+        status->set(activity);
+    }
+    ~ActivityScope() {
+        if (status) status->set(previous);
+    }
+    ActivityScope(const ActivityScope &) = delete;
+    ActivityScope &operator=(const ActivityScope &) = delete;
+};
+
+// statistiques d'un segment, accumulées par le découpeur pendant l'écriture
+struct SegmentStats {
+    uint64_t bytes = 0;          // octets du fichier .ts (overhead TS compris)
+    uint64_t payload_bytes = 0;
+    unsigned int frames = 0;
+    unsigned int keyframes = 0;
+    uint64_t peak_bitrate = 0;   // bit/s, fenêtre glissante de 1 s
+    uint64_t write_syscalls = 0;
+    double duration = 0.0;
+    double flush_ms = 0.0;       // écriture différée : latence du vidage
+    uint64_t cache_bytes = 0;    // écriture différée : occupation du cache à la remise
+    int64_t first_arrival_ns = 0;  // horloge monotone, 0 = inconnu
+    int64_t last_arrival_ns = 0;
+
+    [[nodiscard]] uint64_t avg_bitrate() const {
+        return duration > 0.0 ? static_cast<uint64_t>(static_cast<double>(bytes) * 8.0 / duration) : 0;
+    }
+};
+
+struct SegmentEntry {
+    unsigned int duration = 0;
+    SegmentStats stats;
+    std::string uri;    // tel qu'écrit dans la playlist
+    std::string path;   // fichier sur disque
+    bool discontinuity = false;  // reprise par un autre processus avant ce segment
+};
+
+Result<void>write_idx_file(
+    const std::string &index_path,
+    const std::string &tmp_path,
+    const std::vector<SegmentEntry> &segments,
+    unsigned int offset,
+    unsigned int discontinuity_sequence,
+    unsigned int max_duration,
+    bool islast
+) {
+
+    if (segments.empty()) {
+        return {};
+    }
+
+    FILE *fp = fopen(tmp_path.c_str(), "w");
+    if (!fp) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}' pour écriture: {}", tmp_path, std::strerror(errno)));
+    }
+
+    std::print(fp, "#EXTM3U\n#EXT-X-VERSION:3\n"
+                    "#EXT-X-MEDIA-SEQUENCE:{}\n#EXT-X-TARGETDURATION:{}\n",
+               offset, max_duration);
+    if (discontinuity_sequence > 0) std::print(fp, "#EXT-X-DISCONTINUITY-SEQUENCE:{}\n", discontinuity_sequence);
+
+    for (std::size_t i = 0; i < segments.size(); i++) {
+        if (segments[i].discontinuity) std::print(fp, "#EXT-X-DISCONTINUITY\n");
+        if (uint64_t kbps = segments[i].stats.avg_bitrate() / 1000; kbps > 0)
+            std::print(fp, "#EXT-X-BITRATE:{}\n", kbps);
+        std::print(fp, "#EXTINF:{},\n{}\n", segments[i].duration, segments[i].uri);
+    }
+
+    if (islast) std::print(fp, "#EXT-X-ENDLIST\n");
+
+    fclose(fp);
+
+    if (std::error_code ec; !fs::exists(tmp_path) ||
+        (fs::rename(tmp_path,index_path, ec), ec)) {
+        return std::unexpected(std::format("Impossible de renommer '{}' vers '{}'", tmp_path, index_path));
+    }
+
+    return {};
+}
+
+// état d'une playlist publiée, relu lors d'une prise de relais
+struct PlaylistState {
+    unsigned int media_sequence = 1;
+    unsigned int discontinuity_sequence = 0;
+    std::vector<SegmentEntry> entries;
+    bool ended = false;
+};
+
+Result<PlaylistState> read_playlist(const std::string &index_path) {
+    std::ifstream in(index_path);
+    if (!in) return std::unexpected(std::format("Impossible de lire '{}'", index_path));
+
+    PlaylistState state;
+    fs::path dir = fs::path(index_path).parent_path();
+    std::optional<double> extinf;
+    uint64_t kbps = 0;
+    bool discontinuity = false;
+    auto number = [](std::string_view line, std::size_t prefix) {
+        return parse_number<unsigned int>(line.substr(prefix), "playlist").value_or(0);
+    };
+
+    for (std::string line; std::getline(in, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::string_view l = line;
+        if (l.starts_with("#EXT-X-MEDIA-SEQUENCE:")) {
+            state.media_sequence = number(l, 22);
+        } else if (l.starts_with("#EXT-X-DISCONTINUITY-SEQUENCE:")) {
+            state.discontinuity_sequence = number(l, 30);
+        } else if (l == "#EXT-X-DISCONTINUITY") {
+            discontinuity = true;
+        } else if (l.starts_with("#EXT-X-BITRATE:")) {
+            kbps = number(l, 15);
+        } else if (l.starts_with("#EXTINF:")) {
+            l.remove_prefix(8);
+            extinf = parse_number<double>(l.substr(0, l.find(',')), "playlist").value_or(0.0);
+        } else if (l == "#EXT-X-ENDLIST") {
+            state.ended = true;
+        } else if (!l.empty() && l.front() != '#' && extinf) {
+            SegmentEntry entry;
+            entry.duration = static_cast<unsigned int>(std::rint(*extinf));
+            entry.stats.duration = *extinf;
+            entry.stats.bytes = static_cast<uint64_t>(static_cast<double>(kbps) * 1000.0 / 8.0 * *extinf);
+            entry.uri = line;
+            if (l.find("://") == std::string_view::npos) {
+                entry.path = fs::path(line).is_absolute() ? line : (dir / line).string();
+            }
+            entry.discontinuity = std::exchange(discontinuity, false);
+            state.entries.push_back(std::move(entry));
+            extinf.reset();
+            kbps = 0;
+        }
+    }
+    return state;
+}
+
+// playlist à reprendre : seulement en secours, et si elle existe
+Result<std::optional<PlaylistState>> takeover_playlist(const SegmenterOptions &opts) {
+    if (!opts.standby && !opts.resume) return std::nullopt;
+    if (std::error_code ec; !fs::exists(opts.index_file, ec)) return std::nullopt;
+    auto state = read_playlist(opts.index_file);
+    if (!state) return std::unexpected(state.error());
+    return std::optional<PlaylistState>(std::move(*state));
+}
+
+// Propriété d'un dossier de sortie : flock exclusif sur <dir>/.segmenter.lock.
+// Le noyau libère le verrou à la mort du processus, un secours en attente le
+// reprend aussitôt. Le fichier n'est jamais supprimé (course avec flock).
+struct StreamLock {
+    int fd = -1;
+    std::string path;
+
+    StreamLock() = default;
+    ~StreamLock() {
+        if (fd >= 0) ::close(fd);
+    }
+    StreamLock(const StreamLock &) = delete;
+    StreamLock &operator=(const StreamLock &) = delete;
+    StreamLock(StreamLock &&other) noexcept : fd(std::exchange(other.fd, -1)), path(std::move(other.path)) {}
+
+    static std::string owner(int fd) {
+        char buf[256] = {};
+        ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+        std::string info(buf, n > 0 ? static_cast<std::size_t>(n) : 0);
+        while (!info.empty() && info.back() == '\n') info.pop_back();
+        return info.empty() ? "inconnu" : info;
+    }
+
+    static Result<StreamLock> acquire(const std::string &dir, bool wait) {
+        StreamLock lock;
+        lock.path = dir + "/.segmenter.lock";
+        lock.fd = ::open(lock.path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (lock.fd < 0) {
+            return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", lock.path, std::strerror(errno)));
+        }
+
+        if (flock(lock.fd, LOCK_EX | LOCK_NB) != 0) {
+            if (errno != EWOULDBLOCK) {
+                return std::unexpected(std::format("flock '{}': {}", lock.path, std::strerror(errno)));
+            }
+            if (!wait) {
+                return std::unexpected(std::format("'{}' est déjà utilisé par {}", dir, owner(lock.fd)));
+            }
+            std::println("[Secours] En attente du dossier '{}' (propriétaire : {})", dir, owner(lock.fd));
+            while (flock(lock.fd, LOCK_EX) != 0) {
+                if (errno != EINTR) {
+                    return std::unexpected(std::format("flock '{}': {}", lock.path, std::strerror(errno)));
+                }
+            }
+        }
+
+        char host[256] = {};
+        gethostname(host, sizeof(host) - 1);
+        std::string info = std::format("pid={} host={} since={}\n", getpid(), host, std::time(nullptr));
+        if (ftruncate(lock.fd, 0) != 0 || pwrite(lock.fd, info.data(), info.size(), 0) < 0) {
+            std::println(stderr, "[Verrou] Impossible d'écrire le propriétaire dans '{}'", lock.path);
+        }
+        return lock;
+    }
+};
+
+// Latence arrivée -> playlist (dernier paquet du segment -> segment publié) :
+// histogramme par paliers sur les derniers segments, alerte au-delà du SLO.
+// Mesurée depuis le premier paquet, elle contiendrait toute la durée du
+// segment : ce second chiffre n'est que rapporté.
+constexpr std::size_t LATENCY_WINDOW = 128;
+constexpr std::array<double, 10> LATENCY_BUCKETS_MS = {50, 100, 250, 500, 1000, 2000, 5000, 10000, 20000, 60000};
+
+struct LatencyTracker {
+    double slo_ms;
+    std::deque<double> window;
+    std::array<uint64_t, LATENCY_BUCKETS_MS.size() + 1> histogram{};  // dernier = au-delà
+    uint64_t samples = 0;
+    uint64_t breaches = 0;
+    double last_ms = 0.0;
+    double max_ms = 0.0;
+
+    explicit LatencyTracker(double slo_ms) : slo_ms(slo_ms) {}
+
+    static std::size_t bucket(double ms) {
+        return static_cast<std::size_t>(std::ranges::lower_bound(LATENCY_BUCKETS_MS, ms) - LATENCY_BUCKETS_MS.begin());
+    }
+
+    // renvoie vrai si le SLO est dépassé
+    bool add(double ms) {
+        window.push_back(ms);
+        histogram[bucket(ms)]++;
+        if (window.size() > LATENCY_WINDOW) {
+            histogram[bucket(window.front())]--;
+            window.pop_front();
+        }
+        samples++;
+        last_ms = ms;
+        max_ms = std::max(max_ms, ms);
+        bool breached = slo_ms > 0.0 && ms > slo_ms;
+        if (breached) breaches++;
+        return breached;
+    }
+
+    [[nodiscard]] double percentile(double p) const {
+        if (window.empty()) return 0.0;
+        std::vector<double> sorted(window.begin(), window.end());
+        auto nth = sorted.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(sorted.size() - 1));
+        std::ranges::nth_element(sorted, nth);
+        return *nth;
+    }
+};
+
+std::string json_escape(std::string_view text) {
+    std::string out;
+    for (char c : text) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) {
+            out += std::format("\\u{:04x}", c);
+            continue;
+        }
+        out += c;
+    }
+    return out;
+}
+
+// sidecar JSON des stats, même fenêtre que la playlist
+Result<void> write_stats_file(
+    const std::string &stats_path,
+    const std::vector<SegmentEntry> &segments,
+    unsigned int offset,
+    const LatencyTracker *latency = nullptr
+) {
+    if (segments.empty()) {
+        return {};
+    }
+
+    std::string tmp_path = unique_tmp_path(stats_path);
+    FILE *fp = fopen(tmp_path.c_str(), "w");
+    if (!fp) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}' pour écriture: {}", tmp_path, std::strerror(errno)));
+    }
+
+    std::print(fp, "{{\n  \"media_sequence\": {},\n  \"segments\": [\n", offset);
+    for (std::size_t i = 0; i < segments.size(); i++) {
+        const SegmentStats &st = segments[i].stats;
+        std::print(fp,
+                   "    {{\"sequence\": {}, \"uri\": \"{}\", \"duration\": {:.3f}, "
+                   "\"bytes\": {}, \"payload_bytes\": {}, \"frames\": {}, \"keyframes\": {}, "
+                   "\"avg_bitrate\": {}, \"peak_bitrate\": {}, \"write_syscalls\": {}, "
+                   "\"flush_ms\": {:.1f}, \"cache_bytes\": {}}}{}\n",
+                   i + offset, json_escape(segments[i].uri), st.duration,
+                   st.bytes, st.payload_bytes, st.frames, st.keyframes,
+                   st.avg_bitrate(), st.peak_bitrate, st.write_syscalls,
+                   st.flush_ms, st.cache_bytes, i + 1 < segments.size() ? "," : "");
+    }
+    std::print(fp, "  ]");
+    if (latency && latency->samples > 0) {
+        std::string buckets, counts;
+        for (double b : LATENCY_BUCKETS_MS) buckets += std::format("{}{}", buckets.empty() ? "" : ", ", b);
+        for (uint64_t c : latency->histogram) counts += std::format("{}{}", counts.empty() ? "" : ", ", c);
+        std::print(fp,
+                   ",\n  \"publish_latency\": {{\"last_ms\": {:.1f}, \"p50_ms\": {:.1f}, \"p95_ms\": {:.1f}, "
+                   "\"p99_ms\": {:.1f}, \"max_ms\": {:.1f}, \"slo_ms\": {:.0f}, \"breaches\": {}, "
+                   "\"window\": {}, \"buckets_ms\": [{}], \"counts\": [{}]}}",
+                   latency->last_ms, latency->percentile(0.50), latency->percentile(0.95),
+                   latency->percentile(0.99), latency->max_ms, latency->slo_ms, latency->breaches,
+                   latency->window.size(), buckets, counts);
+    }
+    std::print(fp, "\n}}\n");
+    fclose(fp);
+
+    if (std::error_code ec; (fs::rename(tmp_path, stats_path, ec), ec)) {
+        return std::unexpected(std::format("Impossible de renommer '{}' vers '{}'", tmp_path, stats_path));
+    }
+    return {};
+}
+
+// Index binaire par flux (<index>.idx) : en-tête + enregistrements de taille fixe,
+// en ajout seul. Le lecteur mmap le fichier et fait une recherche dichotomique
+// sur start_pts. Ordre d'octets natif, PTS en 1/90000.
+constexpr char SEGIDX_MAGIC[8] = {'S', 'E', 'G', 'I', 'D', 'X', '0', '1'};
+constexpr uint32_t SEGIDX_VERSION = 1;
+constexpr uint32_t SEGIDX_FLAG_LAST = 1u << 0;
+constexpr uint32_t SEGIDX_FLAG_DISCONTINUITY = 1u << 1;
+constexpr int SEGIDX_CLOCK = 90000;
+
+struct SegIdxHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    int32_t tb_num;
+    int32_t tb_den;
+    uint64_t reserved;
+};
+
+struct SegIdxRecord {
+    uint64_t sequence;
+    int64_t start_pts;
+    int64_t duration;
+    uint64_t bytes;
+    uint32_t filename_id;
+    uint32_t flags;
+};
+
+static_assert(sizeof(SegIdxHeader) == 32 && sizeof(SegIdxRecord) == 40, "layout de l'index figé");
+
+Result<void> create_segment_index(const std::string &path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return std::unexpected(std::format("Impossible de créer '{}': {}", path, std::strerror(errno)));
+    }
+    SegIdxHeader header{};
+    std::memcpy(header.magic, SEGIDX_MAGIC, sizeof(header.magic));
+    header.version = SEGIDX_VERSION;
+    header.record_size = sizeof(SegIdxRecord);
+    header.tb_num = 1;
+    header.tb_den = SEGIDX_CLOCK;
+
+    ssize_t n = write(fd, &header, sizeof(header));
+    close(fd);
+    if (n != static_cast<ssize_t>(sizeof(header))) {
+        return std::unexpected(std::format("Impossible d'écrire l'en-tête de '{}'", path));
+    }
+    return {};
+}
+
+// un seul write() en O_APPEND : un lecteur concurrent voit un enregistrement entier ou rien
+Result<void> append_segment_index(const std::string &path, const SegIdxRecord &record) {
+    int fd = open(path.c_str(), O_WRONLY | O_APPEND);
+    if (fd < 0) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", path, std::strerror(errno)));
+    }
+    ssize_t n = write(fd, &record, sizeof(record));
+    close(fd);
+    if (n != static_cast<ssize_t>(sizeof(record))) {
+        return std::unexpected(std::format("Écriture incomplète dans '{}'", path));
+    }
+    return {};
+}
+
+// dernier enregistrement : point de reprise après un blocage
+Result<SegIdxRecord> last_segment_record(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", path, std::strerror(errno)));
+    struct stat st{};
+    SegIdxRecord record{};
+    bool ok = fstat(fd, &st) == 0 &&
+              st.st_size >= static_cast<off_t>(sizeof(SegIdxHeader) + sizeof(SegIdxRecord)) &&
+              pread(fd, &record, sizeof(record), st.st_size - static_cast<off_t>(sizeof(record))) ==
+              static_cast<ssize_t>(sizeof(record));
+    close(fd);
+    if (!ok) return std::unexpected(std::format("Aucun segment dans '{}'", path));
+    return record;
+}
+
+// segment contenant l'instant `seconds` (dernier start_pts <= cible)
+Result<SegIdxRecord> lookup_segment_index(const std::string &path, double seconds) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", path, std::strerror(errno)));
+    }
+    struct stat st{};
+    if (fstat(fd, &st) < 0 || st.st_size < static_cast<off_t>(sizeof(SegIdxHeader))) {
+        close(fd);
+        return std::unexpected(std::format("Index '{}' invalide", path));
+    }
+    auto size = static_cast<std::size_t>(st.st_size);
+    void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return std::unexpected(std::format("mmap de '{}' impossible: {}", path, std::strerror(errno)));
+    }
+
+    const auto *header = static_cast<const SegIdxHeader *>(map);
+    Result<SegIdxRecord> result = std::unexpected(std::format("Aucun segment à {}s dans '{}'", seconds, path));
+    if (std::memcmp(header->magic, SEGIDX_MAGIC, sizeof(header->magic)) != 0 ||
+        header->record_size != sizeof(SegIdxRecord)) {
+        result = std::unexpected(std::format("Index '{}' invalide", path));
+    } else {
+        const auto *records = reinterpret_cast<const SegIdxRecord *>(header + 1);
+        std::size_t count = (size - sizeof(SegIdxHeader)) / sizeof(SegIdxRecord);
+        auto target = static_cast<int64_t>(std::llround(seconds * header->tb_den / header->tb_num));
+
+        const SegIdxRecord *it = std::upper_bound(records, records + count, target,
+            [](int64_t ts, const SegIdxRecord &r) { return ts < r.start_pts; });
+        if (it != records) {
+            const SegIdxRecord &rec = *(it - 1);
+            if (target < rec.start_pts + rec.duration) result = rec;
+        }
+    }
+    munmap(map, size);
+    return result;
+}
+
+// Sortie d'un segment : AVIOContext maison sur un fd. En direct, chaque vidage
+// d'avio (buffer de ~250 ms) est écrit tel quel, sans copie. En écriture
+// différée, les vidages sont regroupés dans des blocs de taille de coalescence
+// gardés en mémoire (réservés sur le budget du cache), écrits d'un seul writev
+// par le pool.
+constexpr std::size_t AVIO_BUFFER_MIN = 64 * 1024;
+constexpr std::size_t AVIO_BUFFER_MAX = 4 * 1024 * 1024;
+constexpr std::size_t WRITE_COALESCE_MAX = 16 * 1024 * 1024;
+
+// Budget mémoire du cache d'écriture différée. Le muxer réserve chaque bloc
+// avant de le remplir et n'attend que si le budget est épuisé; la mémoire est
+// rendue quand le segment a été vidé sur disque.
+struct CacheBudget {
+    std::size_t limit;
+    std::size_t used = 0;
+    std::mutex mtx;
+    std::condition_variable cv;
+
+    std::size_t peak = 0;
+    uint64_t stalls = 0;
+    double stall_seconds = 0.0;
+
+    explicit CacheBudget(std::size_t limit) : limit(limit) {}
+    CacheBudget(const CacheBudget &) = delete;
+    CacheBudget &operator=(const CacheBudget &) = delete;
+
+    // own : ce que l'appelant tient déjà; s'il est seul dans le cache, il passe
+    void reserve(std::size_t n, std::size_t own) {
+        std::unique_lock lock(mtx);
+        if (used > own && used + n > limit) {
+            auto started = std::chrono::steady_clock::now();
+            cv.wait(lock, [&] {
+                return used == own || used + n <= limit;
+            });
+            stalls++;
+            stall_seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        }
+        used += n;
+        peak = std::max(peak, used);
+    }
+
+    void release(std::size_t n) {
+        {
+            std::unique_lock lock(mtx);
+            used -= n;
+        }
+        cv.notify_all();
+    }
+
+    // réduit ou rend le budget; ce qui est déjà réservé reste acquis
+    void set_limit(std::size_t n) {
+        {
+            std::unique_lock lock(mtx);
+            limit = n;
+        }
+        cv.notify_all();
+    }
+
+    [[nodiscard]] std::size_t occupancy() {
+        std::unique_lock lock(mtx);
+        return used;
+    }
+};
+
+struct SegmentWriter {
+    int fd = -1;
+    std::string path;       // nom publié
+    std::string tmp_path;   // écrit ici, renommé sans écrasement à la fermeture
+    AVIOContext *pb = nullptr;
+    std::vector<std::vector<uint8_t>> pending;  // écriture différée seulement
+    std::size_t pending_bytes = 0;
+    std::size_t coalesce = AVIO_BUFFER_MIN;     // taille des blocs de pending
+    uint64_t syscalls = 0;
+    uint64_t bytes_written = 0;
+    int error = 0;
+    CacheBudget *budget = nullptr;   // non nul : tout reste en mémoire jusqu'à finish()
+    std::size_t reserved = 0;
+
+    // banc d'essai (--inject-write-latency-ms) : attente avant chaque écriture
+    static inline std::atomic<int> injected_latency_ms{0};
+
+    SegmentWriter() = default;
+    ~SegmentWriter() {
+        if (budget && reserved) budget->release(reserved);
+        if (pb) {
+            av_freep(&pb->buffer);
+            avio_context_free(&pb);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            unlink(tmp_path.c_str());
+        }
+    }
+    SegmentWriter(const SegmentWriter &) = delete;
+    SegmentWriter &operator=(const SegmentWriter &) = delete;
+
+    static int write_packet(void *opaque, const uint8_t *buf, int size) {
+        auto *w = static_cast<SegmentWriter *>(opaque);
+        if (w->error) return w->error;
+
+        if (!w->budget) {
+            // direct : le buffer AVIO part tel quel
+            iovec iov{const_cast<uint8_t *>(buf), static_cast<std::size_t>(size)};
+            if (auto res = w->write_all(&iov, 1); !res) return w->error;
+            return size;
+        }
+
+        // écriture différée : le segment reste en mémoire jusqu'au vidage par le
+        // pool, en blocs pleins de `coalesce` octets (réservés bloc par bloc)
+        auto left = static_cast<std::size_t>(size);
+        while (left > 0) {
+            if (w->pending.empty() || w->pending.back().size() == w->pending.back().capacity()) {
+                w->budget->reserve(w->coalesce, w->reserved);
+                w->reserved += w->coalesce;
+                w->pending.emplace_back().reserve(w->coalesce);
+            }
+            std::vector<uint8_t> &block = w->pending.back();
+            std::size_t n = std::min(left, block.capacity() - block.size());
+            block.insert(block.end(), buf, buf + n);
+            buf += n;
+            left -= n;
+        }
+        w->pending_bytes += size;
+        return size;
+    }
+
+    // écrit tous les iovec, par writev de IOV_MAX au plus (EINTR et écritures partielles)
+    VoidResult write_all(iovec *iov, std::size_t count) {
+        std::size_t first = 0;
+        while (first < count) {
+            int batch = static_cast<int>(std::min<std::size_t>(count - first, IOV_MAX));
+            ssize_t n;
+            {
+                ActivityScope io(ThreadActivity::BlockedIo);
+                if (int delay = injected_latency_ms.load(std::memory_order_relaxed); delay > 0) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+                }
+                n = writev(fd, iov + first, batch);
+            }
+            syscalls++;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                error = AVERROR(errno);
+                return std::unexpected(std::format("Écriture de '{}' impossible: {}", path, std::strerror(errno)));
+            }
+            bytes_written += n;
+            // écriture partielle : on avance dans les iovec
+            auto left = static_cast<std::size_t>(n);
+            while (first < count && left >= iov[first].iov_len) {
+                left -= iov[first].iov_len;
+                first++;
+            }
+            if (first < count) {
+                iov[first].iov_base = static_cast<uint8_t *>(iov[first].iov_base) + left;
+                iov[first].iov_len -= left;
+            }
+        }
+        return {};
+    }
+
+    // écriture différée : les blocs gardés en mémoire, d'un seul writev
+    VoidResult flush() {
+        std::vector<iovec> iov;
+        iov.reserve(pending.size());
+        for (auto &chunk : pending) iov.push_back(iovec{chunk.data(), chunk.size()});
+        auto res = write_all(iov.data(), iov.size());
+        pending.clear();
+        pending_bytes = 0;
+        return res;
+    }
+
+    // octets pas encore écrits : buffer AVIO + blocs en mémoire
+    [[nodiscard]] std::size_t buffered_bytes() const {
+        return pending_bytes + (pb ? static_cast<std::size_t>(pb->buf_ptr - pb->buffer) : 0);
+    }
+
+    // vide avio puis les blocs en attente et ferme le fichier
+    // un segment déjà publié sous ce nom (autre processus) n'est jamais écrasé
+    VoidResult finish() {
+        avio_flush(pb);
+        auto res = flush();
+        // une erreur d'écriture directe n'est vue qu'ici, avio_flush l'avale
+        if (res && error) res = std::unexpected(std::format("Écriture de '{}' impossible", path));
+        if (::close(fd) < 0 && res) {
+            res = std::unexpected(std::format("Fermeture de '{}' impossible: {}", path, std::strerror(errno)));
+        }
+        fd = -1;
+        if (res) res = rename_noreplace(tmp_path, path);
+        if (!res) unlink(tmp_path.c_str());
+        return res;
+    }
+};
+
+// taille du buffer AVIO : ~250 ms au débit mesuré, bornée
+std::size_t adaptive_avio_buffer(uint64_t bitrate) {
+    std::size_t size = static_cast<std::size_t>(bitrate / 8 / 4);
+    return std::clamp(size, AVIO_BUFFER_MIN, AVIO_BUFFER_MAX);
+}
+
+Result<std::unique_ptr<SegmentWriter>> open_next_segment(
+    AVFormatContext *output_ctx,
+    const std::string &dir,
+    const std::string &name,
+    unsigned int idx,
+    const std::string &ext,
+    std::size_t buffer_size
+) {
+    auto writer = std::make_unique<SegmentWriter>();
+    writer->path = std::format("{}/{}-{}{}", dir, name, idx, ext);
+    writer->tmp_path = unique_tmp_path(writer->path);
+
+    writer->fd = open(writer->tmp_path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (writer->fd < 0)
+    return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", writer->tmp_path, std::strerror(errno)));
+
+    auto *buffer = static_cast<unsigned char *>(av_malloc(buffer_size));
+    if (buffer) {
+        writer->pb = avio_alloc_context(buffer, static_cast<int>(buffer_size), 1, writer.get(),
+                                        nullptr, SegmentWriter::write_packet, nullptr);
+        if (!writer->pb) av_free(buffer);
+    }
+    if (!writer->pb)
+    return std::unexpected(std::format("Impossible d'allouer le contexte AVIO de '{}'", writer->path));
+
+    output_ctx->pb = writer->pb;
+    std::println("Segment : '{}'", writer->path);
+    return writer;
+}
+
+// Chien de garde : chaque étape horodate sa progression (paquet lu, paquet
+// muxé, segment fermé). Si l'une ne bouge plus pendant stall_timeout, l'entrée
+// est interrompue (AVIOInterruptCB), les files fermées, et le job reprend depuis
+// le dernier segment publié. Un thread bloqué dans le noyau (NFS) ne rend pas
+// la main : après un délai de grâce le processus sort avec EXIT_STALLED.
+constexpr int EXIT_STALLED = 75;  // EX_TEMPFAIL : relancer avec --resume
+constexpr double WATCHDOG_GRACE = 10.0;
+
+struct StageProgress {
+    std::atomic<int64_t> last_read;
+    std::atomic<int64_t> last_mux;
+    std::atomic<int64_t> last_segment;
+    std::atomic<bool> abort{false};
+    std::atomic<bool> paused{false};  // attente légitime (verrou du secours)
+    std::string stalled_stage;  // écrit par le chien de garde avant abort
+
+    StageProgress() : last_read(monotonic_ns()), last_mux(monotonic_ns()), last_segment(monotonic_ns()) {}
+    StageProgress(const StageProgress &) = delete;
+    StageProgress &operator=(const StageProgress &) = delete;
+
+    static void touch(std::atomic<int64_t> &stage) {
+        stage.store(monotonic_ns(), std::memory_order_relaxed);
+    }
+
+    static int interrupt(void *opaque) {
+        return static_cast<StageProgress *>(opaque)->abort.load() ? 1 : 0;
+    }
+
+    [[nodiscard]] AVIOInterruptCB callback() {
+        return AVIOInterruptCB{interrupt, this};
+    }
+};
+
+struct Watchdog {
+    StageProgress progress;
+    std::atomic<PacketQueue *> queue{nullptr};  // fermée en cas de blocage
+    double timeout;
+    double segment_timeout;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool stopped = false;
+    std::thread thread;
+
+    Watchdog(double timeout, double segment_duration)
+        : timeout(timeout), segment_timeout(timeout + 4.0 * segment_duration) {
+        thread = std::thread(&Watchdog::run, this);
+    }
+    ~Watchdog() {
+        stop();
+    }
+    Watchdog(const Watchdog &) = delete;
+    Watchdog &operator=(const Watchdog &) = delete;
+
+    void stop() {
+        {
+            std::unique_lock lock(mtx);
+            stopped = true;
+        }
+        cv.notify_all();
+        if (thread.joinable()) thread.join();
+    }
+
+    [[nodiscard]] bool fired() const {
+        return progress.abort.load();
+    }
+
+    void pause() {
+        progress.paused = true;
+    }
+
+    void unpause() {
+        StageProgress::touch(progress.last_read);
+        StageProgress::touch(progress.last_mux);
+        StageProgress::touch(progress.last_segment);
+        progress.paused = false;
+    }
+
+    void run() {
+        std::unique_lock lock(mtx);
+        while (!cv.wait_for(lock, std::chrono::seconds(1), [this] { return stopped; })) {
+            if (progress.paused) continue;
+            int64_t now = monotonic_ns();
+            auto age = [now](const std::atomic<int64_t> &stage) {
+                return static_cast<double>(now - stage.load(std::memory_order_relaxed)) / 1e9;
+            };
+            double read_age = age(progress.last_read);
+            double mux_age = age(progress.last_mux);
+            double segment_age = age(progress.last_segment);
+
+            // file pleine : le lecteur attend le muxer, c'est l'écriture qui bloque
+            PacketQueue *q = queue.load();
+            bool queue_full = q && q->size() >= q->capacity;
+            std::string stage;
+            if (mux_age > timeout && (queue_full || read_age <= timeout)) {
+                stage = "écriture";
+            } else if (read_age > timeout) {
+                stage = "lecture";
+            } else if (segment_age > segment_timeout) {
+                stage = "fermeture de segment";
+            }
+            if (stage.empty()) continue;
+
+            std::println(stderr, "[Watchdog] Blocage : étape '{}' immobile (dernier paquet lu il y a {:.1f} s, "
+                                 "muxé il y a {:.1f} s, segment fermé il y a {:.1f} s)",
+                         stage, read_age, mux_age, segment_age);
+            progress.stalled_stage = std::move(stage);
+            progress.abort = true;
+            if (q) q->close();
+
+            if (!cv.wait_for(lock, std::chrono::duration<double>(WATCHDOG_GRACE), [this] { return stopped; })) {
+                std::println(stderr, "[Watchdog] Le pipeline ne se débloque pas, sortie (code {})", EXIT_STALLED);
+                std::_Exit(EXIT_STALLED);
+            }
+            return;
+        }
+    }
+};
+
+void thread_reader(
+    AVFormatContext *input_ctx,
+    int in_video_idx,
+    int in_audio_idx,
+    PacketQueue &queue,
+    StageProgress *progress
+    ) {
+    auto pkt_result = AVPacketGuard::create();
+    if (!pkt_result) {
+        std::println(stderr, "[Lecteur] Erreur: {}", pkt_result.error());
+        queue.close();
+        return;
+    }
+    AVPacketGuard pkt = std::move(*pkt_result);
+    PacketBufferPool &pool = PacketBufferPool::instance();
+    ThreadAttach attach("lecteur");
+    StagePin pin(PipelineStage::Reader);
+
+    for (;;) {
+        int ret;
+        {
+            ActivityScope io(ThreadActivity::BlockedIo);
+            ret = av_read_frame(input_ctx, pkt);
+        }
+        if (ret < 0) {
+            if (ret != AVERROR_EOF && ret != AVERROR_EXIT) {
+                char errbuf[FF_INPUT_BUF_SIZE];
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                StatusBoard::instance().set_error(std::format("Lecture: {}", errbuf));
+            }
+            break;
+        }
+        bool is_video = (pkt->stream_index == in_video_idx);
+        bool is_audio = (pkt->stream_index == in_audio_idx);
+
+        if (!is_video && !is_audio) {
+            av_packet_unref(pkt);
+            continue;
+        }
+
+        // payload partagé s'il est compté, sinon recopié dans le pool
+        auto copy_result = pool.copy_packet(pkt);
+        av_packet_unref(pkt);
+        if (!copy_result) {
+            std::println(stderr, "[Lecteur] Erreur: {}", copy_result.error());
+            StatusBoard::instance().set_error(copy_result.error());
+            break;
+        }
+
+        int64_t arrival = monotonic_ns();
+        stamp_arrival(*copy_result, arrival);
+        if (progress) progress->last_read.store(arrival, std::memory_order_relaxed);
+        ActivityScope wait(ThreadActivity::Waiting);
+        if (!queue.push(*copy_result)) break;
+    }
+    queue.close();
+    std::println("[Lecteur] Terminé (pool: {} paquets recopiés, {} chunks huge, {} chunks normaux, {} Mo, "
+                 "{} chunks rendus, {} allocs hors pool)",
+                 pool.copied_packets.load(), pool.huge_chunks.load(), pool.normal_chunks.load(),
+                 pool.reserved_bytes() / (1024 * 1024), pool.released_chunks.load(), pool.fallback_allocs.load());
+}
+
+// IdxTask + IdxQueue
+struct IdxTask {
+    std::string idx_path;
+    std::string tmp_path;
+    std::string stats_path;
+    std::string seg_index_path;
+    std::optional<SegIdxRecord> record;
+    std::vector<SegmentEntry> segments;
+    unsigned int offset = 0;
+    unsigned int discontinuity_sequence = 0;
+    unsigned int max_duration = 0;
+    bool islast = false;
+    std::string old_filename;
+    std::string old_thumbnail;  // vignette du segment retiré (--thumbnails)
+};
+
+struct IdxQueue {
+    std::queue<IdxTask> tasks;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+
+    IdxQueue() = default;
+    IdxQueue(const IdxQueue &) = delete;
+    IdxQueue &operator=(const IdxQueue &) = delete;
+
+    void push (IdxTask task) {
+        {
+            std::unique_lock lock(mtx);
+            tasks.push(std::move(task));
+        }
+        cv.notify_one();
+    }
+
+    [[nodiscard]] std::optional<IdxTask> pop () {
+        std::unique_lock lock(mtx);
+
+        cv.wait(lock, [this] {
+            return !tasks.empty() || closed;
+        });
+
+        if (tasks.empty()) {
+            return std::nullopt;
+        }
 
         IdxTask out = std::move(tasks.front());
         tasks.pop();
 
-        return out;
+        return out;
+    }
+
+    void close() {
+       {
+           std::unique_lock lock(mtx);
+           closed = true;
+       }
+        cv.notify_all();
+    }
+
+    [[nodiscard]] std::size_t size () {
+        std::unique_lock lock(mtx);
+        return tasks.size();
+    }
+};
+
+void thread_idx_writer(IdxQueue &queue, double latency_slo) {
+    ThreadAttach attach("index");
+    StagePin pin(PipelineStage::Writer);
+    LatencyTracker latency(latency_slo * 1000.0);
+    LatencyTracker from_first(0.0);
+    for (;;) {
+        std::optional<IdxTask> task;
+        {
+            ActivityScope wait(ThreadActivity::Waiting);
+            task = queue.pop();
+        }
+        if (!task) break;
+        ActivityScope io(ThreadActivity::BlockedIo);
+        auto result = write_idx_file(task->idx_path, task->tmp_path, task->segments, task->offset,
+                                     task->discontinuity_sequence, task->max_duration, task->islast);
+        if (!result) {
+            std::println(stderr, "[Index] Erreur: {}", result.error());
+            StatusBoard::instance().set_error(result.error());
+        }
+        // le dernier segment de la photo vient d'être listé
+        if (result && task->record && !task->segments.empty() && task->segments.back().stats.last_arrival_ns > 0) {
+            const SegmentStats &st = task->segments.back().stats;
+            int64_t now = monotonic_ns();
+            double ms = static_cast<double>(now - st.last_arrival_ns) / 1e6;
+            from_first.add(static_cast<double>(now - st.first_arrival_ns) / 1e6);
+            if (latency.add(ms)) {
+                std::println(stderr, "[SLO] Segment {} listé {:.0f} ms après l'arrivée de son dernier paquet (SLO {:.0f} ms)",
+                             task->record->sequence, ms, latency.slo_ms);
+            }
+        }
+        if (auto stats = write_stats_file(task->stats_path, task->segments, task->offset, &latency); !stats) {
+            std::println(stderr, "[Index] Erreur: {}", stats.error());
+        }
+        if (task->record) {
+            if (auto appended = append_segment_index(task->seg_index_path, *task->record); !appended) {
+                std::println(stderr, "[Index] Erreur: {}", appended.error());
+            }
+        }
+        // supprimé seulement une fois sorti de la playlist publiée
+        if (!task->old_filename.empty()) {
+            std::error_code ec;
+            fs::remove(task->old_filename, ec);
+        }
+        if (!task->old_thumbnail.empty()) {
+            std::error_code ec;
+            fs::remove(task->old_thumbnail, ec);
+        }
+    }
+    if (latency.samples > 0) {
+        std::println("[Latence] dernier paquet -> playlist : p50 {:.0f} ms, p95 {:.0f} ms, p99 {:.0f} ms, max {:.0f} ms, "
+                     "{} dépassement(s) du SLO ; depuis le premier paquet : p50 {:.0f} ms, max {:.0f} ms",
+                     latency.percentile(0.50), latency.percentile(0.95), latency.percentile(0.99),
+                     latency.max_ms, latency.breaches, from_first.percentile(0.50), from_first.max_ms);
+    }
+    std::println("[Index] Terminé");
+}
+
+std::vector<AVRational> stream_time_bases(const AVFormatContext *ctx) {
+    std::vector<AVRational> tbs(ctx->nb_streams);
+    for (unsigned int i = 0; i < ctx->nb_streams; i++) tbs[i] = ctx->streams[i]->time_base;
+    return tbs;
+}
+
+// Entrelaceur borné : fusion par DTS sur des files par flux, avant av_write_frame.
+// Un paquet sort quand chaque flux a une tête (ordre DTS garanti), ou de force
+// quand le budget mémoire ou le retard max est dépassé.
+struct Interleaver {
+    std::vector<std::deque<AVPacket *>> queues;
+    std::vector<AVRational> time_bases;
+    std::vector<bool> active;
+    std::size_t bytes = 0;
+    std::size_t peak_bytes = 0;
+    std::size_t forced = 0;
+    const std::size_t max_bytes;
+    const double max_delay;
+
+    Interleaver(const std::vector<AVRational> &stream_time_bases, const std::vector<int> &stream_ids,
+                std::size_t max_bytes, double max_delay)
+        : queues(stream_time_bases.size()), time_bases(stream_time_bases),
+          active(stream_time_bases.size(), false), max_bytes(max_bytes), max_delay(max_delay) {
+        for (int idx : stream_ids) active[idx] = true;
+    }
+    ~Interleaver() {
+        for (auto &q : queues)
+            for (AVPacket *pkt : q) av_packet_free(&pkt);
+    }
+    Interleaver(const Interleaver &) = delete;
+    Interleaver &operator=(const Interleaver &) = delete;
+
+    static int64_t order_ts(const AVPacket *pkt) {
+        return pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    }
+
+    void push(AVPacket *pkt) {
+        bytes += pkt->size;
+        peak_bytes = std::max(peak_bytes, bytes);
+        queues[pkt->stream_index].push_back(pkt);
+    }
+
+    // écart en secondes entre le paquet le plus récent et la plus vieille tête
+    [[nodiscard]] double buffered_delay() const {
+        double oldest = 0.0, newest = 0.0;
+        bool any = false;
+        for (std::size_t i = 0; i < queues.size(); i++) {
+            if (queues[i].empty()) continue;
+            int64_t head = order_ts(queues[i].front());
+            int64_t tail = order_ts(queues[i].back());
+            if (head == AV_NOPTS_VALUE || tail == AV_NOPTS_VALUE) continue;
+            double h = head * av_q2d(time_bases[i]);
+            double t = tail * av_q2d(time_bases[i]);
+            oldest = any ? std::min(oldest, h) : h;
+            newest = any ? std::max(newest, t) : t;
+            any = true;
+        }
+        return any ? newest - oldest : 0.0;
+    }
+
+    // prochain paquet en ordre DTS, nullptr s'il faut attendre; flush = fin d'entrée
+    [[nodiscard]] AVPacket *pop(bool flush) {
+        int best = -1;
+        bool starved = false;
+        for (std::size_t i = 0; i < queues.size(); i++) {
+            if (!active[i]) continue;
+            if (queues[i].empty()) {
+                starved = true;
+                continue;
+            }
+            if (best < 0) {
+                best = static_cast<int>(i);
+                continue;
+            }
+            int64_t ts = order_ts(queues[i].front());
+            int64_t best_ts = order_ts(queues[best].front());
+            if (ts == AV_NOPTS_VALUE) {
+                best = static_cast<int>(i);
+            } else if (best_ts != AV_NOPTS_VALUE &&
+                       av_compare_ts(ts, time_bases[i], best_ts, time_bases[best]) < 0) {
+                best = static_cast<int>(i);
+            }
+        }
+        if (best < 0) return nullptr;
+
+        if (starved && !flush) {
+            if (bytes <= max_bytes && buffered_delay() <= max_delay) return nullptr;
+            forced++;
+        }
+
+        AVPacket *pkt = queues[best].front();
+        queues[best].pop_front();
+        bytes -= pkt->size;
+        return pkt;
+    }
+};
+
+// Entrée de secours (--backup-input) : démuxée en continu pendant que le
+// primaire alimente la sortie, seul le GOP en cours est gardé. Sur silence ou
+// fin du primaire, la sortie bascule sur la keyframe suivante du secours (au
+// plus tard après --failover-timeout, sur la dernière reçue), décalée pour
+// prolonger la timeline ; le segment courant est fermé et le suivant porte
+// EXT-X-DISCONTINUITY.
+constexpr std::size_t STANDBY_MAX_PACKETS = 4096;  // GOP anormalement long : on repart à vide
+
+struct StandbyBuffer {
+    std::deque<AVPacket *> packets;  // depuis la dernière keyframe vidéo
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+    bool live = false;  // après bascule : plus de purge, le muxer consomme
+    uint64_t keyframes = 0;
+    const std::size_t capacity;
+
+    explicit StandbyBuffer(std::size_t capacity) : capacity(capacity) {}
+    ~StandbyBuffer() {
+        clear();
+    }
+    StandbyBuffer(const StandbyBuffer &) = delete;
+    StandbyBuffer &operator=(const StandbyBuffer &) = delete;
+
+    void clear() {
+        for (AVPacket *pkt : packets) av_packet_free(&pkt);
+        packets.clear();
+    }
+
+    // false si le tampon est fermé (le paquet est alors libéré)
+    bool push(AVPacket *pkt, bool keyframe) {
+        {
+            std::unique_lock lock(mtx);
+            if (!live) {
+                if (keyframe) {
+                    clear();
+                    keyframes++;
+                } else if (packets.empty() || packets.size() >= STANDBY_MAX_PACKETS) {
+                    if (!packets.empty()) clear();
+                    av_packet_free(&pkt);
+                    return !closed;
+                }
+            } else {
+                cv.wait(lock, [this] { return packets.size() < capacity || closed; });
+            }
+            if (closed) {
+                av_packet_free(&pkt);
+                return false;
+            }
+            packets.push_back(pkt);
+        }
+        cv.notify_all();
+        return true;
+    }
+
+    // attend la keyframe suivante au plus timeout, puis livre depuis la dernière reçue
+    void go_live(double timeout) {
+        std::unique_lock lock(mtx);
+        uint64_t seen = keyframes;
+        cv.wait_for(lock, std::chrono::duration<double>(timeout), [&] { return keyframes > seen || closed; });
+        live = true;
+        cv.notify_all();
+    }
+
+    [[nodiscard]] AVPacket *pop() {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [this] { return !packets.empty() || closed; });
+        if (packets.empty()) return nullptr;
+        AVPacket *pkt = packets.front();
+        packets.pop_front();
+        lock.unlock();
+        cv.notify_all();
+        return pkt;
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+struct FailoverSource {
+    PacketQueue *primary = nullptr;
+    StandbyBuffer standby;
+    double timeout;
+    StageProgress *progress;  // chien de garde éventuel
+    std::vector<AVRational> time_bases;  // primaire, par stream_index
+    std::vector<int64_t> last_dts;       // dernier DTS écrit, par stream_index
+    int64_t primary_end_us = INT64_MIN;
+    std::optional<int64_t> offset_us;    // décalage appliqué au secours
+    std::atomic<bool> on_backup{false};  // lu par le thread du secours
+    std::atomic<bool> abandon_primary{false};
+    std::atomic<bool> stopping{false};
+
+    FailoverSource(std::size_t capacity, double timeout, StageProgress *progress)
+        : standby(capacity), timeout(timeout), progress(progress) {}
+    FailoverSource(const FailoverSource &) = delete;
+    FailoverSource &operator=(const FailoverSource &) = delete;
+
+    [[nodiscard]] bool aborted() const {
+        return progress && progress->abort.load();
+    }
+
+    static int interrupt_primary(void *opaque) {
+        auto *f = static_cast<FailoverSource *>(opaque);
+        return f->abandon_primary.load() || f->stopping.load() || f->aborted() ? 1 : 0;
+    }
+
+    static int interrupt_backup(void *opaque) {
+        auto *f = static_cast<FailoverSource *>(opaque);
+        return f->stopping.load() || f->aborted() ? 1 : 0;
+    }
+
+    [[nodiscard]] AVIOInterruptCB primary_callback() {
+        return AVIOInterruptCB{interrupt_primary, this};
+    }
+
+    [[nodiscard]] AVIOInterruptCB backup_callback() {
+        return AVIOInterruptCB{interrupt_backup, this};
+    }
+
+    void start(PacketQueue &queue, std::vector<AVRational> primary_time_bases) {
+        primary = &queue;
+        time_bases = std::move(primary_time_bases);
+        last_dts.assign(time_bases.size(), AV_NOPTS_VALUE);
+    }
+
+    void stop() {
+        stopping = true;
+        standby.close();
+    }
+
+    // Démux du secours : flux remappés sur les index du primaire et DTS/PTS
+    // ramenés à ses time bases, pour que l'entrelaceur et le découpeur ne voient
+    // qu'une seule source.
+    void read_backup(AVFormatContext *ctx, int backup_video, int backup_audio, int video_idx, int audio_idx) {
+        ThreadAttach attach("secours");
+        StagePin pin(PipelineStage::Reader);
+        AVPacket *pkt = av_packet_alloc();
+        PacketBufferPool &pool = PacketBufferPool::instance();
+        auto read = [&] {
+            ActivityScope io(ThreadActivity::BlockedIo);
+            return av_read_frame(ctx, pkt);
+        };
+        while (pkt && read() >= 0) {
+            int target = pkt->stream_index == backup_video ? video_idx
+                       : (pkt->stream_index == backup_audio ? audio_idx : -1);
+            if (target < 0) {
+                av_packet_unref(pkt);
+                continue;
+            }
+            av_packet_rescale_ts(pkt, ctx->streams[pkt->stream_index]->time_base, time_bases[target]);
+            auto copy = pool.copy_packet(pkt);
+            bool keyframe = target == video_idx && (pkt->flags & AV_PKT_FLAG_KEY);
+            av_packet_unref(pkt);
+            if (!copy) {
+                std::println(stderr, "[Secours] Erreur: {}", copy.error());
+                break;
+            }
+            (*copy)->stream_index = target;
+            int64_t arrival = monotonic_ns();
+            stamp_arrival(*copy, arrival);
+            if (on_backup && progress) progress->last_read.store(arrival, std::memory_order_relaxed);
+            if (!standby.push(*copy, keyframe)) break;
+        }
+        av_packet_free(&pkt);
+        standby.close();
+        if (!stopping) std::println(stderr, "[Secours] Fin de l'entrée de secours");
+    }
+
+    void track(const AVPacket *pkt) {
+        int64_t dts = Interleaver::order_ts(pkt);
+        if (dts == AV_NOPTS_VALUE) return;
+        last_dts[pkt->stream_index] = dts;
+        int64_t end = av_rescale_q(dts + std::max<int64_t>(pkt->duration, 0), time_bases[pkt->stream_index],
+                                   AV_TIME_BASE_Q);
+        primary_end_us = std::max(primary_end_us, end);
+    }
+
+    // false : paquet à jeter (sans horodatage avant la jointure, ou recouvrant le primaire)
+    bool shift(AVPacket *pkt) {
+        AVRational tb = time_bases[pkt->stream_index];
+        int64_t ts = Interleaver::order_ts(pkt);
+        if (!offset_us) {
+            if (ts == AV_NOPTS_VALUE) return false;
+            int64_t join_us = primary_end_us == INT64_MIN ? 0 : primary_end_us;
+            offset_us = join_us - av_rescale_q(ts, tb, AV_TIME_BASE_Q);
+        }
+        int64_t delta = av_rescale_q(*offset_us, AV_TIME_BASE_Q, tb);
+        if (pkt->pts != AV_NOPTS_VALUE) pkt->pts += delta;
+        if (pkt->dts != AV_NOPTS_VALUE) pkt->dts += delta;
+
+        int64_t dts = Interleaver::order_ts(pkt);
+        int64_t &last = last_dts[pkt->stream_index];
+        if (dts != AV_NOPTS_VALUE && last != AV_NOPTS_VALUE && dts <= last) return false;
+        if (dts != AV_NOPTS_VALUE) last = dts;
+        return true;
+    }
+
+    // prochain paquet pour l'entrelaceur; switched vaut true au moment de la bascule
+    [[nodiscard]] AVPacket *next(bool &switched) {
+        switched = false;
+        if (!on_backup) {
+            bool timed_out = false;
+            AVPacket *pkt = primary->pop_for(std::chrono::duration<double>(timeout), timed_out);
+            if (pkt) {
+                track(pkt);
+                return pkt;
+            }
+            if (aborted()) return nullptr;
+
+            auto started = std::chrono::steady_clock::now();
+            on_backup = true;
+            switched = true;
+            abandon_primary = true;
+            primary->close();  // le lecteur du primaire s'arrête à son prochain paquet
+            standby.go_live(timeout);
+            std::println(stderr, "[Secours] Bascule sur l'entrée de secours ({}), en {:.0f} ms",
+                         timed_out ? std::format("primaire muet depuis {:.1f} s", timeout) : "fin ou erreur du primaire",
+                         std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+        }
+        while (AVPacket *pkt = standby.pop()) {
+            if (shift(pkt)) return pkt;
+            av_packet_free(&pkt);
+        }
+        return nullptr;
+    }
+};
+
+// Cache d'écriture différée : les segments terminés restent en mémoire et sont
+// vidés par un pool d'écrivains, le muxer ne voit plus la latence du stockage.
+// Les fins de vidage sont relevées par le découpeur, qui publie dans l'ordre.
+struct FlushJob {
+    std::unique_ptr<SegmentWriter> writer;
+    const void *owner = nullptr;
+    unsigned int sequence = 0;
+    std::size_t shard = 0;
+};
+
+struct FlushDone {
+    const void *owner = nullptr;
+    unsigned int sequence = 0;
+    std::size_t shard = 0;
+    double seconds = 0.0;
+    uint64_t syscalls = 0;
+    std::string error;  // vide = succès
+};
+
+struct WriteBehindCache {
+    CacheBudget budget;
+    std::queue<FlushJob> jobs;
+    std::vector<FlushDone> done;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+    std::atomic<uint64_t> completed{0};
+    std::vector<std::thread> workers;
+
+    // latence de vidage
+    uint64_t flushes = 0;
+    double flush_total = 0.0;
+    double flush_max = 0.0;
+
+    WriteBehindCache(std::size_t limit, unsigned int threads) : budget(limit) {
+        for (unsigned int i = 0; i < std::max(1u, threads); i++) {
+            workers.emplace_back(&WriteBehindCache::run, this);
+        }
+    }
+    ~WriteBehindCache() {
+        close();
+    }
+    WriteBehindCache(const WriteBehindCache &) = delete;
+    WriteBehindCache &operator=(const WriteBehindCache &) = delete;
+
+    // remet un segment complet (avio déjà vidé); renvoie l'occupation du cache
+    std::size_t submit(std::unique_ptr<SegmentWriter> writer, const void *owner, unsigned int sequence, std::size_t shard) {
+        {
+            std::unique_lock lock(mtx);
+            jobs.push(FlushJob{std::move(writer), owner, sequence, shard});
+        }
+        cv.notify_all();
+        return budget.occupancy();
+    }
+
+    void run() {
+        ThreadAttach attach("cache");
+        StagePin pin(PipelineStage::Writer);
+        while (true) {
+            FlushJob job;
+            {
+                ActivityScope wait(ThreadActivity::Waiting);
+                std::unique_lock lock(mtx);
+                cv.wait(lock, [this] {
+                    return !jobs.empty() || closed;
+                });
+                if (jobs.empty()) return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+
+            auto started = std::chrono::steady_clock::now();
+            auto res = job.writer->finish();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+            FlushDone result{job.owner, job.sequence, job.shard, seconds, job.writer->syscalls,
+                             res ? std::string{} : res.error()};
+            job.writer.reset();  // rend la mémoire au budget
+
+            {
+                std::unique_lock lock(mtx);
+                done.push_back(std::move(result));
+                flushes++;
+                flush_total += seconds;
+                flush_max = std::max(flush_max, seconds);
+            }
+            completed++;
+            cv.notify_all();
+        }
+    }
+
+    // fins de vidage d'un découpeur; wait : attend qu'il n'ait plus rien en vol
+    std::vector<FlushDone> take_done(const void *owner, std::size_t in_flight, bool wait) {
+        std::vector<FlushDone> mine;
+        std::unique_lock lock(mtx);
+        auto collect = [&] {
+            auto it = std::stable_partition(done.begin(), done.end(),
+                                            [&](const FlushDone &d) { return d.owner != owner; });
+            std::move(it, done.end(), std::back_inserter(mine));
+            done.erase(it, done.end());
+            return mine.size() >= in_flight;
+        };
+        if (wait) {
+            cv.wait(lock, collect);
+        } else {
+            collect();
+        }
+        return mine;
+    }
+
+    void close() {
+        {
+            std::unique_lock lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+        for (std::thread &w : workers) {
+            if (w.joinable()) w.join();
+        }
+    }
+
+    void print_summary(const char *label) {
+        std::unique_lock lock(mtx);
+        std::lock_guard budget_lock(budget.mtx);
+        std::println("[{}] pic {} Ko / {} Ko, {} attentes du muxer ({:.3f} s), vidage moyen {:.1f} ms, max {:.1f} ms",
+                     label, budget.peak / 1024, budget.limit / 1024, budget.stalls, budget.stall_seconds,
+                     flushes ? flush_total * 1000.0 / static_cast<double>(flushes) : 0.0, flush_max * 1000.0);
+    }
+};
+
+// Répartition des segments sur plusieurs dossiers/disques.
+// adaptive : évite les volumes dont la file du périphérique (/sys/.../inflight)
+// ou la latence de fermeture récente est élevée.
+struct OutputShard {
+    std::string dir;
+    std::string uri_prefix;     // vide = même dossier que la playlist
+    std::string inflight_path;  // vide si le périphérique est inconnu
+    double close_ewma = 0.0;    // secondes
+    uint64_t segments = 0;
+};
+
+struct ShardSet {
+    std::vector<OutputShard> shards;
+    ShardPolicy policy;
+    std::size_t next = 0;
+
+    explicit ShardSet(const SegmenterOptions &opts) : policy(opts.shard_policy) {
+        std::vector<std::string> dirs = opts.shard_dirs;
+        if (dirs.empty()) dirs.push_back(opts.output_dir);
+
+        std::error_code ec;
+        fs::path playlist_dir = fs::absolute(fs::path(opts.index_file).parent_path(), ec);
+        for (std::size_t i = 0; i < dirs.size(); i++) {
+            OutputShard shard;
+            shard.dir = dirs[i];
+            if (i < opts.shard_uris.size()) {
+                shard.uri_prefix = opts.shard_uris[i];
+            } else {
+                fs::path rel = fs::absolute(dirs[i], ec).lexically_relative(playlist_dir);
+                if (rel.empty()) rel = fs::absolute(dirs[i], ec);
+                if (rel != ".") shard.uri_prefix = rel.string();
+            }
+            shard.inflight_path = inflight_path(dirs[i]);
+            shards.push_back(std::move(shard));
+        }
+    }
+
+    static std::string inflight_path(const std::string &dir) {
+#ifdef __linux__
+        struct stat st{};
+        if (stat(dir.c_str(), &st) == 0) {
+            std::string path = std::format("/sys/dev/block/{}:{}/inflight", major(st.st_dev), minor(st.st_dev));
+            if (std::error_code ec; fs::exists(path, ec)) return path;
+        }
+#endif
+        return {};
+    }
+
+    // requêtes en cours (lectures + écritures) sur le périphérique
+    [[nodiscard]] static unsigned int device_inflight(const std::string &path) {
+        if (path.empty()) return 0;
+        std::ifstream in(path);
+        unsigned int reads = 0, writes = 0;
+        in >> reads >> writes;
+        return reads + writes;
+    }
+
+    std::size_t pick(const std::string &filename) {
+        std::size_t n = shards.size();
+        std::size_t chosen = next % n;
+        if (policy == ShardPolicy::Hash) {
+            chosen = std::hash<std::string>{}(filename) % n;
+        } else if (policy == ShardPolicy::Adaptive) {
+            double best = 0.0;
+            for (std::size_t k = 0; k < n; k++) {
+                std::size_t i = (next + k) % n;
+                double score = (device_inflight(shards[i].inflight_path) + 1) * (shards[i].close_ewma + 0.001);
+                if (k == 0 || score < best) {
+                    best = score;
+                    chosen = i;
+                }
+            }
+        }
+        next = chosen + 1;
+        shards[chosen].segments++;
+        return chosen;
+    }
+
+    void record_close(std::size_t i, double seconds) {
+        double &ewma = shards[i].close_ewma;
+        ewma = ewma == 0.0 ? seconds : 0.8 * ewma + 0.2 * seconds;
+    }
+
+    [[nodiscard]] std::string uri(std::size_t i, const std::string &filename) const {
+        const std::string &prefix = shards[i].uri_prefix;
+        if (prefix.empty()) return filename;
+        return prefix.ends_with('/') ? prefix + filename : prefix + "/" + filename;
+    }
+};
+
+// Découpeur : reçoit les paquets déjà entrelacés, coupe sur les keyframes vidéo
+// et publie la playlist via l'IdxQueue.
+// Vignettes : seule la première keyframe de chaque segment est décodée, par un
+// petit pool de threads à basse priorité (un thread de décodage chacun). La file
+// est bornée et non bloquante : si le pool est en retard, la vignette est
+// abandonnée plutôt que de ralentir la copie.
+constexpr std::size_t THUMB_QUEUE_PER_WORKER = 2;
+
+using CodecContextPtr = std::unique_ptr<AVCodecContext, void (*)(AVCodecContext *)>;
+
+CodecContextPtr make_codec_context(const AVCodec *codec) {
+    return CodecContextPtr(avcodec_alloc_context3(codec), [](AVCodecContext *c) { avcodec_free_context(&c); });
+}
+
+// encode une image en JPEG (tmp + rename : le fichier peut déjà être servi)
+Result<void> write_jpeg(const AVFrame *frame, const std::string &path) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (!codec) return std::unexpected("Encodeur MJPEG indisponible");
+    CodecContextPtr enc = make_codec_context(codec);
+    if (!enc) return std::unexpected("Impossible d'allouer l'encodeur MJPEG");
+
+    enc->width = frame->width;
+    enc->height = frame->height;
+    enc->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    enc->time_base = AVRational{1, 25};
+    enc->flags |= AV_CODEC_FLAG_QSCALE;
+    enc->global_quality = FF_QP2LAMBDA * 4;
+    if (avcodec_open2(enc.get(), codec, nullptr) < 0) {
+        return std::unexpected("Impossible d'ouvrir l'encodeur MJPEG");
+    }
+
+    AVPacketGuard pkt;
+    if (avcodec_send_frame(enc.get(), frame) < 0 || avcodec_send_frame(enc.get(), nullptr) < 0 ||
+        avcodec_receive_packet(enc.get(), pkt) < 0) {
+        return std::unexpected(std::format("Échec de l'encodage JPEG de '{}'", path));
+    }
+
+    std::string tmp_path = unique_tmp_path(path);
+    FILE *fp = fopen(tmp_path.c_str(), "wb");
+    if (!fp) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}' pour écriture: {}", tmp_path, std::strerror(errno)));
+    }
+    bool written = fwrite(pkt->data, 1, pkt->size, fp) == static_cast<std::size_t>(pkt->size);
+    if (fclose(fp) != 0 || !written) {
+        return std::unexpected(std::format("Impossible d'écrire '{}'", tmp_path));
+    }
+    if (std::error_code ec; (fs::rename(tmp_path, path, ec), ec)) {
+        return std::unexpected(std::format("Impossible de renommer '{}' vers '{}'", tmp_path, path));
+    }
+    return {};
+}
+
+std::string vtt_timestamp(double seconds) {
+    auto ms = static_cast<int64_t>(std::llround(std::max(seconds, 0.0) * 1000));
+    return std::format("{:02}:{:02}:{:02}.{:03}", ms / 3600000, ms / 60000 % 60, ms / 1000 % 60, ms % 1000);
+}
+
+struct ThumbnailJob {
+    AVPacket *pkt = nullptr;
+    unsigned int sequence = 0;
+    double start = 0.0;
+    std::string dir;  // dossier (shard) du segment
+};
+
+// hauteur de vignette au ratio de la source, 0 tant que ses dimensions sont
+// inconnues (direct, stdin : fixée à la première image décodée)
+int thumb_height(int thumb_width, int width, int height) {
+    if (width <= 0 || height <= 0) return 0;
+    return std::max(2, static_cast<int>(std::lround(static_cast<double>(thumb_width) * height / width)) & ~1);
+}
+
+struct ThumbnailPool {
+    const SegmenterOptions &opts;
+    const AVCodecParameters *par;
+    int tile_w;
+    int tile_h;
+    std::once_flag tile_h_once;
+    std::string sprite_stem;    // "<playlist>-sprite"
+    std::string vtt_path;
+
+    // file de décodage
+    std::queue<ThumbnailJob> jobs;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+    const std::size_t capacity;
+    std::vector<std::thread> workers;
+
+    // vignettes décodées, par position (séquence - première séquence). Avec
+    // --max-segments, les positions sorties de la playlist sont oubliées : la
+    // mémoire et le WebVTT restent à la taille de la fenêtre
+    std::mutex tiles_mtx;
+    std::map<unsigned int, AVFrame *> tiles;
+    std::map<unsigned int, double> starts;   // débuts des vignettes encore listées
+    std::size_t sheets_reserved = 0;         // planches [0, n) réservées par un thread
+    std::size_t sheets_seen = 0;             // planches ayant reçu une vignette
+    std::set<std::size_t> published_sheets;  // planches sur disque, citées par le WebVTT
+    unsigned int retired_pos = 0;            // positions < retired_pos hors playlist
+    std::optional<unsigned int> first_sequence;
+    std::mutex vtt_mtx;
+    bool vtt_published = false;
+    double origin = 0.0;
+
+    std::atomic<uint64_t> submitted{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> decoded{0};
+    std::atomic<uint64_t> failed{0};
+
+    ThumbnailPool(const SegmenterOptions &opts, const AVStream *video)
+        : opts(opts), par(video->codecpar),
+          tile_w(opts.thumb_width & ~1),
+          tile_h(thumb_height(opts.thumb_width, par->width, par->height)),
+          sprite_stem(fs::path(opts.index_file).replace_extension().string() + "-sprite"),
+          vtt_path(fs::path(opts.index_file).replace_extension(".thumbs.vtt").string()),
+          capacity(std::max(1u, opts.thumb_workers) * THUMB_QUEUE_PER_WORKER) {
+        for (unsigned int i = 0; i < std::max(1u, opts.thumb_workers); i++) {
+            workers.emplace_back(&ThumbnailPool::run, this);
+        }
+    }
+
+    ~ThumbnailPool() {
+        close();
+        for (std::thread &w : workers) {
+            if (w.joinable()) w.join();
+        }
+        while (!jobs.empty()) {
+            av_packet_free(&jobs.front().pkt);
+            jobs.pop();
+        }
+        for (auto &[pos, frame] : tiles) av_frame_free(&frame);
+    }
+    ThumbnailPool(const ThumbnailPool &) = delete;
+    ThumbnailPool &operator=(const ThumbnailPool &) = delete;
+
+    [[nodiscard]] std::size_t tiles_per_sheet() const {
+        return static_cast<std::size_t>(opts.sprite_columns) * opts.sprite_columns;
+    }
+
+    // appelé par le découpeur; ne bloque jamais
+    void submit(const AVPacket *pkt, unsigned int sequence, double start, const std::string &dir) {
+        {
+            std::unique_lock lock(mtx);
+            if (!first_sequence) {
+                first_sequence = sequence;
+                origin = start;
+            }
+            if (closed || jobs.size() >= capacity) {
+                dropped++;
+                return;
+            }
+            AVPacket *ref = av_packet_clone(pkt);
+            if (!ref) {
+                dropped++;
+                return;
+            }
+            jobs.push(ThumbnailJob{ref, sequence, start, dir});
+            submitted++;
+        }
+        cv.notify_one();
+    }
+
+    void close() {
+        {
+            std::unique_lock lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+
+    std::optional<ThumbnailJob> pop() {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [this] {
+            return !jobs.empty() || closed;
+        });
+        if (jobs.empty()) return std::nullopt;
+        ThumbnailJob job = jobs.front();
+        jobs.pop();
+        return job;
+    }
+
+    void run() {
+        ThreadAttach attach("vignettes");
+#ifdef __linux__
+        // sous Linux la priorité nice est par thread
+        setpriority(PRIO_PROCESS, static_cast<id_t>(gettid()), 19);
+#endif
+        const AVCodec *decoder = avcodec_find_decoder(par->codec_id);
+        CodecContextPtr dec = make_codec_context(decoder);
+        bool ready = decoder && dec && avcodec_parameters_to_context(dec.get(), par) >= 0;
+        if (ready) {
+            dec->thread_count = 1;
+            dec->skip_loop_filter = AVDISCARD_ALL;  // qualité suffisante pour une vignette
+            ready = avcodec_open2(dec.get(), decoder, nullptr) >= 0;
+        }
+        if (!ready) std::println(stderr, "[Vignettes] Décodeur indisponible, vignettes ignorées");
+
+        SwsContext *sws = nullptr;
+        AVFrame *frame = av_frame_alloc();
+        while (auto job = pop()) {
+            if (ready && frame) {
+                // une keyframe seule se décode sans référence : envoi puis vidage
+                avcodec_send_packet(dec.get(), job->pkt);
+                avcodec_send_packet(dec.get(), nullptr);
+                bool got = avcodec_receive_frame(dec.get(), frame) >= 0;
+                while (avcodec_receive_frame(dec.get(), frame) >= 0) {}
+                avcodec_flush_buffers(dec.get());
+                if (got) {
+                    std::call_once(tile_h_once, [&] {
+                        if (tile_h == 0) tile_h = thumb_height(opts.thumb_width, frame->width, frame->height);
+                    });
+                    sws = sws_getCachedContext(sws, frame->width, frame->height,
+                                               static_cast<AVPixelFormat>(frame->format),
+                                               tile_w, tile_h, AV_PIX_FMT_YUVJ420P, SWS_BILINEAR,
+                                               nullptr, nullptr, nullptr);
+                }
+                AVFrame *tile = got && sws ? scale_tile(sws, frame) : nullptr;
+                av_frame_unref(frame);
+                if (tile) {
+                    store(*job, tile);
+                } else {
+                    failed++;
+                }
+            }
+            av_packet_free(&job->pkt);
+        }
+        av_frame_free(&frame);
+        if (sws) sws_freeContext(sws);
+    }
+
+    AVFrame *scale_tile(SwsContext *sws, const AVFrame *frame) {
+        AVFrame *tile = av_frame_alloc();
+        if (!tile) return nullptr;
+        tile->width = tile_w;
+        tile->height = tile_h;
+        tile->format = AV_PIX_FMT_YUVJ420P;
+        if (av_frame_get_buffer(tile, 0) < 0) {
+            av_frame_free(&tile);
+            return nullptr;
+        }
+        sws_scale(sws, frame->data, frame->linesize, 0, frame->height, tile->data, tile->linesize);
+        return tile;
+    }
+
+    void store(const ThumbnailJob &job, AVFrame *tile) {
+        std::string thumb_path = std::format("{}/{}-{}.jpg", job.dir, opts.base_name, job.sequence);
+        if (auto res = write_jpeg(tile, thumb_path); !res) {
+            std::println(stderr, "[Vignettes] {}", res.error());
+        }
+        decoded++;
+
+        std::vector<std::size_t> ready_sheets;
+        {
+            std::lock_guard lock(tiles_mtx);
+            unsigned int pos = job.sequence - *first_sequence;
+            std::size_t sheet = pos / tiles_per_sheet();
+            if (pos < retired_pos) {
+                // retiré pendant le décodage : l'index a peut-être déjà supprimé
+                // le segment, la vignette écrite après ne serait jamais supprimée
+                std::error_code ec;
+                fs::remove(thumb_path, ec);
+            }
+            if (sheet < sheets_reserved || pos < retired_pos) {
+                // planche déjà écrite ou segment sorti de la playlist : vignette trop tardive
+                av_frame_free(&tile);
+                dropped++;
+                return;
+            }
+            tiles[pos] = tile;
+            starts[pos] = job.start;
+            sheets_seen = std::max(sheets_seen, sheet + 1);
+            // une planche est écrite quand le pool l'a dépassée de deux planches
+            while (sheets_reserved + 1 < sheet) ready_sheets.push_back(sheets_reserved++);
+        }
+        for (std::size_t k : ready_sheets) write_sheet(k);
+        if (!ready_sheets.empty()) write_vtt();
+    }
+
+    // retire les vignettes de la planche k et l'écrit
+    void write_sheet(std::size_t k) {
+        std::vector<std::pair<unsigned int, AVFrame *>> sheet_tiles;
+        {
+            std::lock_guard lock(tiles_mtx);
+            auto first = tiles.lower_bound(static_cast<unsigned int>(k * tiles_per_sheet()));
+            auto last = tiles.lower_bound(static_cast<unsigned int>((k + 1) * tiles_per_sheet()));
+            sheet_tiles.assign(first, last);
+            tiles.erase(first, last);
+        }
+        // toutes ses vignettes sont déjà sorties de la playlist
+        if ((k + 1) * tiles_per_sheet() <= retired_pos) {
+            for (auto &[pos, tile] : sheet_tiles) av_frame_free(&tile);
+            return;
+        }
+        if (sheet_tiles.empty()) return;
+
+        int cols = opts.sprite_columns;
+        int rows = static_cast<int>((sheet_tiles.back().first % tiles_per_sheet()) / cols) + 1;
+        AVFrame *sheet = av_frame_alloc();
+        if (sheet) {
+            sheet->width = cols * tile_w;
+            sheet->height = rows * tile_h;
+            sheet->format = AV_PIX_FMT_YUVJ420P;
+        }
+        if (!sheet || av_frame_get_buffer(sheet, 0) < 0) {
+            std::println(stderr, "[Vignettes] Impossible d'allouer la planche {}", k);
+        } else {
+            // fond noir, puis copie plan par plan
+            for (int plane = 0; plane < 3; plane++) {
+                int h = plane ? sheet->height / 2 : sheet->height;
+                std::memset(sheet->data[plane], plane ? 128 : 0, static_cast<std::size_t>(sheet->linesize[plane]) * h);
+            }
+            for (const auto &[pos, tile] : sheet_tiles) {
+                int index = static_cast<int>(pos % tiles_per_sheet());
+                int x = (index % cols) * tile_w;
+                int y = (index / cols) * tile_h;
+                for (int plane = 0; plane < 3; plane++) {
+                    int shift = plane ? 1 : 0;
+                    for (int line = 0; line < (tile_h >> shift); line++) {
+                        std::memcpy(sheet->data[plane] + static_cast<std::ptrdiff_t>((y >> shift) + line) * sheet->linesize[plane] + (x >> shift),
+                                    tile->data[plane] + static_cast<std::ptrdiff_t>(line) * tile->linesize[plane],
+                                    static_cast<std::size_t>(tile_w >> shift));
+                    }
+                }
+            }
+            if (auto res = write_jpeg(sheet, std::format("{}-{}.jpg", sprite_stem, k)); !res) {
+                std::println(stderr, "[Vignettes] {}", res.error());
+            } else {
+                std::lock_guard lock(tiles_mtx);
+                published_sheets.insert(k);
+            }
+        }
+        av_frame_free(&sheet);
+        for (auto &[pos, tile] : sheet_tiles) av_frame_free(&tile);
+    }
+
+    // réécrit le WebVTT avec les planches publiées et les segments encore listés :
+    // le scrubbing en direct suit les planches au fil de l'eau. end_time = fin du
+    // flux, sinon la dernière vignette connue dure un segment nominal.
+    void write_vtt(std::optional<double> end_time = std::nullopt) {
+        struct Cue {
+            unsigned int pos;
+            double start;
+            double end;
+        };
+        std::lock_guard vtt_lock(vtt_mtx);
+        std::vector<Cue> cues;
+        {
+            std::lock_guard lock(tiles_mtx);
+            for (auto it = starts.begin(); it != starts.end(); ++it) {
+                if (!published_sheets.contains(it->first / tiles_per_sheet())) continue;
+                auto next = std::next(it);
+                double cue_end = next != starts.end() ? next->second
+                                                      : end_time.value_or(it->second + opts.segment_duration);
+                cues.push_back(Cue{it->first, it->second, cue_end});
+            }
+        }
+        // rien de publié : pas de fichier; publié puis vidé par la fenêtre : réécrit
+        if (cues.empty() && !vtt_published) return;
+
+        std::string tmp_path = unique_tmp_path(vtt_path);
+        FILE *fp = fopen(tmp_path.c_str(), "w");
+        if (!fp) {
+            std::println(stderr, "[Vignettes] Impossible d'ouvrir '{}': {}", tmp_path, std::strerror(errno));
+            return;
+        }
+        std::string sprite_name = fs::path(sprite_stem).filename().string();
+        std::print(fp, "WEBVTT\n");
+        for (const Cue &cue : cues) {
+            int index = static_cast<int>(cue.pos % tiles_per_sheet());
+            std::print(fp, "\n{} --> {}\n{}-{}.jpg#xywh={},{},{},{}\n",
+                       vtt_timestamp(cue.start - origin), vtt_timestamp(cue.end - origin),
+                       sprite_name, cue.pos / tiles_per_sheet(),
+                       (index % opts.sprite_columns) * tile_w, (index / opts.sprite_columns) * tile_h, tile_w, tile_h);
+        }
+        fclose(fp);
+        if (std::error_code ec; (fs::rename(tmp_path, vtt_path, ec), ec)) {
+            std::println(stderr, "[Vignettes] Impossible de renommer '{}' vers '{}'", tmp_path, vtt_path);
+        } else {
+            vtt_published = true;
+        }
+    }
+
+    // le segment `sequence` vient de sortir de la playlist (--max-segments) :
+    // ses cues quittent le WebVTT, puis les planches dont plus aucune cue n'est
+    // listée sont supprimées. Appelé par le découpeur; la vignette du segment est
+    // supprimée par l'index avec le segment
+    void retire(unsigned int sequence) {
+        if (!first_sequence || sequence < *first_sequence) return;
+        std::vector<std::size_t> unlisted;
+        {
+            std::lock_guard lock(tiles_mtx);
+            retired_pos = std::max(retired_pos, sequence - *first_sequence + 1);
+            starts.erase(starts.begin(), starts.lower_bound(retired_pos));
+            while (!published_sheets.empty() && (*published_sheets.begin() + 1) * tiles_per_sheet() <= retired_pos) {
+                unlisted.push_back(*published_sheets.begin());
+                published_sheets.erase(published_sheets.begin());
+            }
+        }
+        write_vtt();
+        for (std::size_t k : unlisted) {
+            std::error_code ec;
+            fs::remove(std::format("{}-{}.jpg", sprite_stem, k), ec);
+        }
+    }
+
+    // fin de flux : attend le pool, écrit les planches restantes et le WebVTT
+    void finish(double end_time) {
+        close();
+        for (std::thread &w : workers) w.join();
+        workers.clear();
+
+        for (; sheets_reserved < sheets_seen; sheets_reserved++) write_sheet(sheets_reserved);
+        write_vtt(end_time);
+        std::println("[Vignettes] {} décodées, {} abandonnées, {} en échec", decoded.load(), dropped.load(), failed.load());
+    }
+};
+
+// Temps du muxer bloqué à chaque fermeture de segment : vidage et écriture en
+// direct, simple remise au pool en écriture différée. Série complète, le
+// banc d'essai des sorties lit la ligne [Fermeture].
+constexpr std::array<double, 10> CLOSE_BUCKETS_MS = {1, 2, 5, 10, 20, 50, 100, 250, 500, 1000};
+
+struct CloseLatency {
+    std::vector<double> samples;
+
+    void add(double ms) { samples.push_back(ms); }
+
+    [[nodiscard]] double percentile(double p) const {
+        if (samples.empty()) return 0.0;
+        std::vector<double> sorted = samples;
+        auto nth = sorted.begin() + static_cast<std::ptrdiff_t>(p * static_cast<double>(sorted.size() - 1));
+        std::ranges::nth_element(sorted, nth);
+        return *nth;
+    }
+
+    void print(uint64_t bytes) const {
+        std::println("[Fermeture] {} segments, {} octets, latence ms p50 {:.2f} p90 {:.2f} p99 {:.2f} max {:.2f}",
+                     samples.size(), bytes, percentile(0.50), percentile(0.90), percentile(0.99),
+                     samples.empty() ? 0.0 : std::ranges::max(samples));
+        std::array<uint64_t, CLOSE_BUCKETS_MS.size() + 1> counts{};  // dernier = au-delà
+        for (double ms : samples) {
+            counts[std::ranges::lower_bound(CLOSE_BUCKETS_MS, ms) - CLOSE_BUCKETS_MS.begin()]++;
+        }
+        std::string line;
+        for (std::size_t i = 0; i < CLOSE_BUCKETS_MS.size(); i++) {
+            line += std::format(" <={}:{}", CLOSE_BUCKETS_MS[i], counts[i]);
+        }
+        std::println("[Fermeture] histogramme ms{} >{}:{}", line, CLOSE_BUCKETS_MS.back(), counts.back());
+    }
+};
+
+struct SegmentCutter {
+    const SegmenterOptions &opts;
+    std::vector<AVRational> in_time_bases;  // par stream_index d'entrée
+    AVFormatContext *output_ctx;
+    IdxQueue &idx_queue;
+    int in_video_idx;
+    int in_audio_idx;
+    int out_video_idx;
+    int out_audio_idx;
+    std::string tmp_idx_file;
+    std::string stats_file;
+    std::string seg_index_file;
+
+    ShardSet shards;
+    std::size_t current_shard = 0;
+    std::string current_path;
+    std::string current_uri;
+    std::unique_ptr<SegmentWriter> writer;
+    uint64_t last_bitrate = 0;
+    uint64_t total_syscalls = 0;
+    uint64_t total_bytes = 0;
+    CloseLatency close_latency;
+
+    std::vector<SegmentEntry> segments;
+    std::optional<SegIdxRecord> pending_record;
+    unsigned int max_duration = 0;
+    unsigned int output_idx = 1;
+    unsigned int list_offset = 1;
+    unsigned int discontinuity_sequence = 0;
+    bool next_discontinuity = false;
+    bool resumed = false;
+    double segment_start = 0.0;
+    double pkt_time = 0.0;
+    bool wait_first_keyframe = true;
+    ThumbnailPool *thumbnails = nullptr;
+    unsigned int thumb_sequence = 0;  // dernier segment soumis au pool
+    StageProgress *progress = nullptr;
+    std::optional<double> resume_from;  // paquets antérieurs ignorés (reprise)
+
+    // écriture différée : publication retardée jusqu'au vidage, dans l'ordre
+    struct DeferredPublish {
+        unsigned int sequence;
+        IdxTask task;
+        bool flushed = false;
+    };
+    WriteBehindCache *cache = nullptr;
+    std::deque<DeferredPublish> deferred;
+    uint64_t seen_completed = 0;
+
+    // stats du segment courant, débit crête sur fenêtre glissante de 1 s
+    SegmentStats current;
+    std::deque<std::pair<double, int>> rate_window;
+    uint64_t rate_window_bytes = 0;
+
+    SegmentCutter(const SegmenterOptions &opts, std::vector<AVRational> in_time_bases, uint64_t initial_bitrate,
+                  AVFormatContext *output_ctx, IdxQueue &idx_queue,
+                  int in_video_idx, int in_audio_idx, int out_video_idx, int out_audio_idx)
+        : opts(opts), in_time_bases(std::move(in_time_bases)), output_ctx(output_ctx), idx_queue(idx_queue),
+          in_video_idx(in_video_idx), in_audio_idx(in_audio_idx),
+          out_video_idx(out_video_idx), out_audio_idx(out_audio_idx),
+          tmp_idx_file(unique_tmp_path(opts.index_file)),
+          stats_file(fs::path(opts.index_file).replace_extension(".stats.json").string()),
+          seg_index_file(fs::path(opts.index_file).replace_extension(".idx").string()),
+          shards(opts), last_bitrate(initial_bitrate) {}
+
+    ~SegmentCutter() {
+        // le pb appartient au writer, pas à AVOutputGuard
+        if (writer) output_ctx->pb = nullptr;
+    }
+    SegmentCutter(const SegmentCutter &) = delete;
+    SegmentCutter &operator=(const SegmentCutter &) = delete;
+
+    // Prise de relais : reprend la fenêtre publiée par le propriétaire précédent,
+    // le prochain segment porte EXT-X-DISCONTINUITY. Les segments qu'il a écrits
+    // sans les publier et ses .tmp sont supprimés : le verrou est à nous.
+    void resume(const PlaylistState &state) {
+        segments = state.entries;
+        list_offset = state.media_sequence;
+        discontinuity_sequence = state.discontinuity_sequence;
+        output_idx = list_offset + static_cast<unsigned int>(segments.size());
+        for (const SegmentEntry &e : segments) max_duration = std::max(max_duration, e.duration);
+        next_discontinuity = !segments.empty();
+        resumed = true;
+
+        std::string prefix = opts.base_name + "-";
+        std::string playlist = fs::path(opts.index_file).filename().string();
+        for (const OutputShard &shard : shards.shards) {
+            std::error_code ec;
+            for (const auto &entry : fs::directory_iterator(shard.dir, ec)) {
+                std::string name = entry.path().filename().string();
+                bool orphan = false;
+                if (name.starts_with(prefix) && name.ends_with(opts.extension)) {
+                    std::string_view seq(name);
+                    seq = seq.substr(prefix.size(), seq.size() - prefix.size() - opts.extension.size());
+                    auto n = parse_number<unsigned int>(seq, "segment");
+                    orphan = n && *n >= output_idx;
+                }
+                bool stale_tmp = name.ends_with(".tmp") && (name.starts_with(prefix) || name.starts_with(playlist));
+                if (orphan || stale_tmp) {
+                    fs::remove(entry.path(), ec);
+                }
+            }
+        }
+        std::println("[Reprise] {} segments repris, suite au segment {}", segments.size(), output_idx);
+    }
+
+    VoidResult open_segment() {
+        std::string filename = std::format("{}-{}{}", opts.base_name, output_idx, opts.extension);
+        current_shard = shards.pick(filename);
+
+        std::size_t buffer_size = opts.avio_buffer_size ? opts.avio_buffer_size : adaptive_avio_buffer(last_bitrate);
+        auto opened = open_next_segment(output_ctx, shards.shards[current_shard].dir,
+                                        opts.base_name, output_idx, opts.extension, buffer_size);
+        if (!opened) return std::unexpected(opened.error());
+        writer = std::move(*opened);
+        if (cache) {
+            writer->budget = &cache->budget;
+            // écriture différée : les vidages sont regroupés en blocs de coalescence
+            writer->coalesce = std::max(buffer_size, opts.write_coalesce_bytes ? opts.write_coalesce_bytes
+                                                                               : std::min(buffer_size * 8, WRITE_COALESCE_MAX));
+        }
+        current_path = writer->path;
+        current_uri = shards.uri(current_shard, filename);
+        return {};
+    }
+
+    void publish(bool islast, std::string old_filename = {}, std::string old_thumbnail = {}) {
+        IdxTask task{
+            .idx_path = opts.index_file,
+            .tmp_path = tmp_idx_file,
+            .stats_path = stats_file,
+            .seg_index_path = seg_index_file,
+            .record = std::exchange(pending_record, std::nullopt),
+            .segments = segments,
+            .offset = list_offset,
+            .discontinuity_sequence = discontinuity_sequence,
+            .max_duration = max_duration,
+            .islast = islast,
+            .old_filename = std::move(old_filename),
+            .old_thumbnail = std::move(old_thumbnail),
+        };
+        if (cache) {
+            deferred.push_back(DeferredPublish{output_idx, std::move(task)});
+        } else {
+            idx_queue.push(std::move(task));
+        }
+    }
+
+    // relève les segments vidés par le cache et publie ceux qui sont prêts, dans l'ordre
+    VoidResult collect_flushed(bool wait) {
+        if (!cache || deferred.empty()) return {};
+        if (!wait && cache->completed.load() == seen_completed) return {};
+        seen_completed = cache->completed.load();
+
+        std::size_t in_flight = wait ? deferred.size() - (std::ranges::count_if(deferred, &DeferredPublish::flushed)) : 0;
+        VoidResult result{};
+        for (FlushDone &done : cache->take_done(this, in_flight, wait)) {
+            if (!done.error.empty() && result) result = std::unexpected(done.error);
+            shards.record_close(done.shard, done.seconds);
+            total_syscalls += done.syscalls;
+            if (done.sequence >= list_offset && done.sequence - list_offset < segments.size()) {
+                SegmentStats &st = segments[done.sequence - list_offset].stats;
+                st.write_syscalls = done.syscalls;
+                st.flush_ms = done.seconds * 1000.0;
+            }
+            for (DeferredPublish &d : deferred) {
+                if (d.sequence == done.sequence) d.flushed = true;
+            }
+        }
+
+        while (!deferred.empty() && deferred.front().flushed) {
+            IdxTask &task = deferred.front().task;
+            // la photo de la fenêtre prend les stats de vidage connues depuis
+            for (std::size_t j = 0; j < task.segments.size(); j++) {
+                unsigned int seq = task.offset + static_cast<unsigned int>(j);
+                if (seq >= list_offset && seq - list_offset < segments.size()) {
+                    task.segments[j].stats = segments[seq - list_offset].stats;
+                }
+            }
+            idx_queue.push(std::move(task));
+            deferred.pop_front();
+        }
+        return result;
+    }
+
+    void account(const AVPacket *pkt, double t, bool is_video, bool is_keyframe) {
+        current.payload_bytes += pkt->size;
+        if (int64_t arrival = packet_arrival(pkt); arrival > 0) {
+            if (current.first_arrival_ns == 0 || arrival < current.first_arrival_ns) current.first_arrival_ns = arrival;
+            current.last_arrival_ns = std::max(current.last_arrival_ns, arrival);
+        }
+        if (is_video) {
+            current.frames++;
+            if (is_keyframe) current.keyframes++;
+        }
+
+        rate_window.emplace_back(t, pkt->size);
+        rate_window_bytes += pkt->size;
+        while (!rate_window.empty() && rate_window.front().first <= t - 1.0) {
+            rate_window_bytes -= rate_window.front().second;
+            rate_window.pop_front();
+        }
+        current.peak_bitrate = std::max(current.peak_bitrate, rate_window_bytes * 8);
+    }
+
+    void add_segment(unsigned int seg_dur, double exact_dur) {
+        current.duration = exact_dur;
+        if (uint64_t rate = current.avg_bitrate(); rate > 0) last_bitrate = rate;
+        pending_record = SegIdxRecord{
+            .sequence = output_idx,
+            .start_pts = std::llround(segment_start * SEGIDX_CLOCK),
+            .duration = std::llround(exact_dur * SEGIDX_CLOCK),
+            .bytes = current.bytes,
+            .filename_id = output_idx,
+            .flags = next_discontinuity ? SEGIDX_FLAG_DISCONTINUITY : 0,
+        };
+        segments.push_back(SegmentEntry{seg_dur, current, current_uri, current_path,
+                                        std::exchange(next_discontinuity, false)});
+        if (seg_dur > max_duration) max_duration = seg_dur;
+        current = SegmentStats{};
+        rate_window.clear();
+        rate_window_bytes = 0;
+    }
+
+    // last : le trailer part dans le dernier segment, après le vidage du muxer
+    // et avant celui de l'AVIO ; plus aucun av_write_frame ensuite
+    void drain_muxer(bool last) {
+        av_write_frame(output_ctx, nullptr);
+        if (last) av_write_trailer(output_ctx);
+    }
+
+    VoidResult close_segment(bool last = false) {
+        auto started = std::chrono::steady_clock::now();
+        if (cache) {
+            // le vidage et la fermeture partent au pool, mesurés par lui
+            drain_muxer(last);
+            avio_flush(writer->pb);
+            current.bytes = writer->pending_bytes;
+            total_bytes += writer->pending_bytes;
+            output_ctx->pb = nullptr;
+            int error = writer->error;
+            current.cache_bytes = cache->submit(std::move(writer), this, output_idx, current_shard);
+            close_latency.add(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+            if (error) return std::unexpected(std::format("Écriture de '{}' impossible", current_path));
+            return {};
+        }
+
+        drain_muxer(last);
+        auto finished = writer->finish();
+        current.bytes = writer->bytes_written;
+        current.write_syscalls = writer->syscalls;
+        total_syscalls += writer->syscalls;
+        total_bytes += writer->bytes_written;
+        output_ctx->pb = nullptr;
+        writer.reset();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+        shards.record_close(current_shard, seconds);
+        close_latency.add(seconds * 1000.0);
+        return finished;
+    }
+
+    VoidResult cut() {
+        if (auto res = close_segment(); !res) return res;
+
+        double exact_dur = pkt_time - segment_start;
+        add_segment(static_cast<unsigned int>(std::rint(exact_dur)), exact_dur);
+
+        std::string old_filename;
+        std::string old_thumbnail;
+        if (opts.max_segments > 0 && segments.size() > static_cast<std::size_t>(opts.max_segments)) {
+            old_filename = segments.front().path;
+            if (thumbnails) {
+                // même dossier et même nom que le segment : <base_name>-<n>.jpg
+                old_thumbnail = fs::path(old_filename).replace_extension(".jpg").string();
+                thumbnails->retire(list_offset);
+            }
+            list_offset++;
+            if (segments.front().discontinuity) discontinuity_sequence++;
+            unsigned int removed = segments.front().duration;
+            segments.erase(segments.begin());
+
+            // recalcule le max seulement si le segment retiré était le max
+            if (removed >= max_duration) {
+                max_duration = 0;
+                for (const SegmentEntry &e : segments) max_duration = std::max(max_duration, e.duration);
+            }
+        }
+        publish(false, std::move(old_filename), std::move(old_thumbnail));
+
+        if (segments.size() >= MAX_SEGMENTS) {
+            return std::unexpected(std::format("Trop de segments ({})", MAX_SEGMENTS));
+        }
+
+        output_idx++;
+        if (progress) StageProgress::touch(progress->last_segment);
+        if (auto opened = open_segment(); !opened) return opened;
+        // chaque segment doit recommencer par PAT/PMT
+        av_opt_set(output_ctx->priv_data, "mpegts_flags", "+resend_headers", 0);
+        segment_start = pkt_time;
+        return {};
+    }
+
+    // changement de source : le segment courant est fermé là où le primaire
+    // s'arrête, le suivant porte EXT-X-DISCONTINUITY
+    VoidResult discontinuity() {
+        if (!wait_first_keyframe && pkt_time > segment_start) {
+            if (auto res = cut(); !res) return res;
+        }
+        next_discontinuity = !segments.empty();
+        return {};
+    }
+
+    // écrit un paquet entrelacé (stream_index d'entrée); le paquet reste à libérer
+    VoidResult write(AVPacket *pkt) {
+        int in_idx = pkt->stream_index;
+        bool is_keyframe = false;
+
+        // reprise : le seek tombe sur la keyframe qui précède, on saute jusqu'au point de reprise
+        if (resume_from && in_idx >= 0 && static_cast<std::size_t>(in_idx) < in_time_bases.size()) {
+            int64_t ts = Interleaver::order_ts(pkt);
+            if (ts != AV_NOPTS_VALUE && ts * av_q2d(in_time_bases[in_idx]) < *resume_from) return {};
+        }
+
+        if (in_idx == in_video_idx) {
+            int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+            pkt_time = ts * av_q2d(in_time_bases[in_video_idx]);
+            is_keyframe = pkt->flags & AV_PKT_FLAG_KEY;
+            if (is_keyframe && wait_first_keyframe) {
+                wait_first_keyframe = false;
+                segment_start = pkt_time;
+            }
+            pkt->stream_index = out_video_idx;
+        } else if (in_idx == in_audio_idx && out_audio_idx >= 0) {
+            pkt->stream_index = out_audio_idx;
+        } else {
+            return {};
+        }
+
+        if (wait_first_keyframe) return {};
+
+        if (auto flushed = collect_flushed(false); !flushed) return flushed;
+
+        // @TODO define 0.25
+        if (is_keyframe && (pkt_time - segment_start) >= (opts.segment_duration - 0.25)) {
+            if (auto res = cut(); !res) return res;
+        }
+
+        if (is_keyframe && thumbnails && thumb_sequence != output_idx) {
+            thumbnails->submit(pkt, output_idx, segment_start, shards.shards[current_shard].dir);
+            thumb_sequence = output_idx;
+        }
+
+        AVRational in_tb = in_time_bases[in_idx];
+        int64_t order_ts = Interleaver::order_ts(pkt);
+        double t = order_ts != AV_NOPTS_VALUE ? order_ts * av_q2d(in_tb) : pkt_time;
+        account(pkt, t, in_idx == in_video_idx, is_keyframe);
+
+        // Rescale timestamp : base tempo. input to output
+        AVStream *out_stream = output_ctx->streams[pkt->stream_index];
+        av_packet_rescale_ts(pkt, in_tb, out_stream->time_base);
+        pkt->pos = -1;
+
+        if (av_write_frame(output_ctx, pkt) < 0) {
+            return std::unexpected("Impossible d'écrire le paquet");
+        }
+        return {};
+    }
+
+    // dernier segment + playlist finale
+    VoidResult finish() {
+        if (wait_first_keyframe) return {};
+
+        if (auto res = close_segment(true); !res) return res;
+
+        double exact_dur = pkt_time - segment_start;
+        unsigned int last_dur = static_cast<unsigned int>(std::rint(exact_dur));
+        if (last_dur == 0) last_dur = 1; // dur min 1.
+        add_segment(last_dur, exact_dur);
+        pending_record->flags |= SEGIDX_FLAG_LAST;
+        publish(true);
+        return collect_flushed(true);
+    }
+};
+
+// instantané écrit par le thread de signaux : files, segment courant, octets en
+// vol, état de chaque thread, dernière erreur; remplacé atomiquement
+Result<void> StatusBoard::dump() {
+    static constexpr std::array<const char *, 4> activity_names = {"working", "waiting", "io", "done"};
+    int64_t now = monotonic_ns();
+    std::string threads_json;
+    std::string queues_json;
+    std::size_t cache_bytes = 0;
+    std::string error;
+    std::string target;
+    {
+        std::lock_guard lock(mtx);
+        target = path;
+        for (const ThreadStatus &t : threads) {
+            ThreadActivity a = t.activity.load(std::memory_order_relaxed);
+            if (a == ThreadActivity::Done) continue;
+            threads_json += std::format("{}\n    {{\"name\": \"{}\", \"state\": \"{}\", \"for_s\": {:.3f}}}",
+                                        threads_json.empty() ? "" : ",", json_escape(t.name),
+                                        activity_names[static_cast<std::size_t>(a)],
+                                        static_cast<double>(now - t.since_ns.load(std::memory_order_relaxed)) / 1e9);
+        }
+        queues_json = std::format("\"packets\": {}, \"packets_capacity\": {}, \"packet_bytes\": {}, "
+                                  "\"index_tasks\": {}, \"budget_percent\": {}",
+                                  packets ? packets->size() : 0, packets ? packets->capacity : 0,
+                                  packets ? packets->queued_bytes() : 0, index ? index->size() : 0,
+                                  budget_percent.load(std::memory_order_relaxed));
+        if (cache) cache_bytes = cache->budget.occupancy();
+        error = last_error.empty() ? "null" : std::format("\"{}\"", json_escape(last_error));
+        dumps++;
+    }
+    if (target.empty()) return {};
+
+    unsigned int seg = segment.load(std::memory_order_relaxed);
+    int64_t opened = segment_opened_ns.load(std::memory_order_relaxed);
+    std::string tmp_path = unique_tmp_path(target);
+    FILE *fp = fopen(tmp_path.c_str(), "w");
+    if (!fp) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}' pour écriture: {}", tmp_path, std::strerror(errno)));
+    }
+    std::print(fp,
+               "{{\n  \"pid\": {},\n  \"time\": {},\n  \"input\": \"{}\",\n  \"uptime_s\": {:.1f},\n"
+               "  \"queues\": {{{}}},\n"
+               "  \"segment\": {{\"index\": {}, \"elapsed_s\": {:.3f}, \"media_s\": {:.3f}, \"packets_muxed\": {}}},\n"
+               "  \"in_flight_bytes\": {{\"interleaver\": {}, \"segment_buffer\": {}, \"write_behind\": {}}},\n"
+               "  \"threads\": [{}\n  ],\n  \"last_error\": {}\n}}\n",
+               getpid(), std::time(nullptr), json_escape(input), static_cast<double>(now - started_ns) / 1e9,
+               queues_json, seg, seg && opened ? static_cast<double>(now - opened) / 1e9 : 0.0,
+               segment_media.load(std::memory_order_relaxed), packets_muxed.load(std::memory_order_relaxed),
+               interleaver_bytes.load(std::memory_order_relaxed),
+               segment_pending_bytes.load(std::memory_order_relaxed), cache_bytes, threads_json, error);
+    fclose(fp);
+
+    if (std::error_code ec; (fs::rename(tmp_path, target, ec), ec)) {
+        return std::unexpected(std::format("Impossible de renommer '{}' vers '{}'", tmp_path, target));
+    }
+    return {};
+}
+
+#ifdef __linux__
+// nom lisible d'une adresse : symbole démanglé, sinon [bibliothèque] ou, pour
+// le segmenteur lui-même, module+décalage à passer à addr2line (les fonctions
+// internes n'ont de nom qu'avec un binaire lié en -rdynamic)
+std::string symbolize(void *pc) {
+    // adresse de retour : pc - 1 tombe dans l'appel lui-même
+    void *lookup = static_cast<char *>(pc) - 1;
+    Dl_info info{};
+    if (dladdr(lookup, &info) == 0 || !info.dli_fname) return std::format("{}", pc);
+    if (info.dli_sname) {
+        int status = 0;
+        char *demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+        std::free(demangled);
+        return name;
+    }
+    static const void *self_base = [] {
+        Dl_info self{};
+        return dladdr(reinterpret_cast<void *>(&symbolize), &self) ? self.dli_fbase : nullptr;
+    }();
+    std::string module = fs::path(info.dli_fname).filename().string();
+    if (info.dli_fbase != self_base) return std::format("[{}]", module);
+    return std::format("{}+0x{:x}", module,
+                       reinterpret_cast<uintptr_t>(lookup) - reinterpret_cast<uintptr_t>(info.dli_fbase));
+}
+#endif
+
+// piles repliées, écrites dans un .tmp puis renommées (le fichier reste lisible
+// pendant une nouvelle écriture à la demande)
+Result<void> SamplingProfiler::write() {
+#ifdef __linux__
+    if (path.empty() || !ring) return {};
+    collect();
+    std::string out;
+    uint64_t total = 0;
+    {
+        std::lock_guard lock(mtx);
+        std::map<void *, std::string> names;
+        for (const auto &[key, count] : stacks) {
+            std::string line = thread_names[reinterpret_cast<uintptr_t>(key[0])];
+            // backtrace va de l'appelé vers la racine; le format replié, à l'inverse
+            for (std::size_t f = key.size() - 1; f >= 1; f--) {
+                auto [it, inserted] = names.try_emplace(key[f]);
+                if (inserted) it->second = symbolize(key[f]);
+                line += ';';
+                // ';' et ' ' sont des séparateurs du format
+                for (char c : it->second) line += c == ';' || c == ' ' ? '_' : c;
+            }
+            out += std::format("{} {}\n", line, count);
+        }
+        total = samples;
+    }
+
+    std::string tmp = unique_tmp_path(path);
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        if (!file || !(file << out) || !file.flush()) {
+            return std::unexpected(std::format("Impossible d'écrire '{}'", tmp));
+        }
+    }
+    if (std::rename(tmp.c_str(), path.c_str()) != 0) {
+        unlink(tmp.c_str());
+        return std::unexpected(std::format("Impossible de publier '{}': {}", path, std::strerror(errno)));
+    }
+    std::println("[Profil] {} échantillons à {} Hz ({} perdus) -> {}", total, hz, dropped.load(), path);
+#endif
+    return {};
+}
+
+// profilage pour la durée du job, piles écrites à la sortie
+struct ProfileSession {
+    bool active = false;
+
+    ProfileSession() = default;
+    ~ProfileSession() {
+        if (!active) return;
+        SamplingProfiler &profiler = SamplingProfiler::instance();
+        profiler.stop();
+        if (auto written = profiler.write(); !written) {
+            std::println(stderr, "[Profil] {}", written.error());
+        }
+    }
+    ProfileSession(const ProfileSession &) = delete;
+    ProfileSession &operator=(const ProfileSession &) = delete;
+
+    Result<void> start(const SegmenterOptions &opts) {
+        if (opts.profile_file.empty()) return {};
+        if (auto started = SamplingProfiler::instance().start(opts.profile_file, opts.profile_hz); !started) {
+            return started;
+        }
+        active = true;
+        return {};
+    }
+};
+
+// Budgets mémoire réglés de l'extérieur : l'orchestrateur écrit dans
+// --budget-file un pourcentage (10..100) des budgets de départ (file de paquets
+// en octets, cache d'écriture différée) quand la pression mémoire ou I/O monte,
+// puis envoie SIGUSR2. Appliqué à la file et au cache du job en cours.
+constexpr unsigned int BUDGET_MIN_PERCENT = 10;
+
+struct MemoryBudget {
+    std::string path;
+    std::size_t queue_bytes = 0;   // budgets à 100 %
+    std::size_t cache_bytes = 0;
+
+    static MemoryBudget &instance() {
+        static MemoryBudget budget;
+        return budget;
+    }
+
+    // fichier absent = 100 %
+    Result<unsigned int> read() const {
+        std::ifstream file(path);
+        if (!file) return 100u;
+        std::string text;
+        file >> text;
+        auto percent = parse_number<unsigned int>(text, "budget-file");
+        if (!percent) return std::unexpected(percent.error());
+        return std::clamp(*percent, BUDGET_MIN_PERCENT, 100u);
+    }
+
+    void apply() const {
+        if (path.empty()) return;
+        auto percent = read();
+        if (!percent) {
+            std::println(stderr, "[Budget] {}", percent.error());
+            return;
+        }
+        StatusBoard &board = StatusBoard::instance();
+        unsigned int previous = board.budget_percent.exchange(*percent);
+        std::lock_guard lock(board.mtx);
+        if (board.packets && queue_bytes) board.packets->set_max_bytes(queue_bytes * *percent / 100);
+        if (board.cache && cache_bytes) board.cache->budget.set_limit(cache_bytes * *percent / 100);
+        if (previous != *percent) {
+            std::println("[Budget] {}% : file {} Ko, cache {} Ko", *percent,
+                         queue_bytes * *percent / 100 / 1024, cache_bytes * *percent / 100 / 1024);
+        }
+    }
+};
+
+// les pointeurs de files suivis par le dump, effacés avant leur destruction
+struct StatusWatch {
+    StatusWatch(PacketQueue *packets, IdxQueue *index, WriteBehindCache *cache) {
+        StatusBoard::instance().watch(packets, index, cache);
+        MemoryBudget::instance().apply();
+    }
+    ~StatusWatch() {
+        StatusBoard::instance().watch(nullptr, nullptr, nullptr);
+    }
+    StatusWatch(const StatusWatch &) = delete;
+    StatusWatch &operator=(const StatusWatch &) = delete;
+};
+
+// SIGUSR1 et SIGUSR2 sont bloqués dans tous les threads (masque posé avant leur
+// création) et reçus ici par sigwait : le dump et la relecture du budget se font
+// hors contexte de signal, sans limite sur ce qu'ils peuvent appeler
+struct StatusSignalThread {
+    sigset_t set{};
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    StatusSignalThread() {
+        sigemptyset(&set);
+        sigaddset(&set, SIGUSR1);
+        sigaddset(&set, SIGUSR2);
+        pthread_sigmask(SIG_BLOCK, &set, nullptr);
+        thread = std::thread([this] {
+            for (;;) {
+                int sig = 0;
+                if (sigwait(&set, &sig) != 0) continue;
+                if (stopping) return;
+                if (sig == SIGUSR2) {
+                    MemoryBudget::instance().apply();
+                    continue;
+                }
+                if (auto dumped = StatusBoard::instance().dump(); !dumped) {
+                    std::println(stderr, "[Statut] {}", dumped.error());
+                }
+                // avec --profile, les piles du moment sont publiées en même temps
+                if (SamplingProfiler::instance().enabled) {
+                    if (auto written = SamplingProfiler::instance().write(); !written) {
+                        std::println(stderr, "[Profil] {}", written.error());
+                    }
+                }
+            }
+        });
+    }
+    ~StatusSignalThread() {
+        stopping = true;
+        pthread_kill(thread.native_handle(), SIGUSR1);
+        thread.join();
+    }
+    StatusSignalThread(const StatusSignalThread &) = delete;
+    StatusSignalThread &operator=(const StatusSignalThread &) = delete;
+};
+
+// Échelle ABR : le flux vidéo est décodé une seule fois, chaque image est
+// partagée (référence) entre les renditions; chaque rendition met à l'échelle et
+// encode sur son propre thread, puis passe par son entrelaceur et son découpeur.
+// Les keyframes sont forcées aux mêmes instants pour aligner les coupes.
+constexpr std::size_t RENDITION_QUEUE_CAPACITY = 8;
+
+struct RenditionItem {
+    AVFrame *frame = nullptr;   // image décodée (référence partagée)
+    AVPacket *pkt = nullptr;    // paquet audio recopié tel quel
+    bool force_key = false;
+
+    void release() {
+        if (frame) av_frame_free(&frame);
+        if (pkt) av_packet_free(&pkt);
+    }
+};
+
+struct RenditionQueue {
+    std::queue<RenditionItem> items;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+    const std::size_t capacity;
+
+    explicit RenditionQueue(std::size_t cap) : capacity(cap) {}
+    ~RenditionQueue() {
+        while (!items.empty()) {
+            items.front().release();
+            items.pop();
+        }
+    }
+    RenditionQueue(const RenditionQueue &) = delete;
+    RenditionQueue &operator=(const RenditionQueue &) = delete;
+
+    void push(RenditionItem item) {
+        {
+            std::unique_lock lock(mtx);
+            cv.wait(lock, [this] {
+                return items.size() < capacity || closed;
+            });
+            if (closed) {
+                item.release();
+                return;
+            }
+            items.push(item);
+        }
+        cv.notify_all();
+    }
+
+    [[nodiscard]] std::optional<RenditionItem> pop() {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [this] {
+            return !items.empty() || closed;
+        });
+        if (items.empty()) return std::nullopt;
+
+        RenditionItem item = items.front();
+        items.pop();
+        lock.unlock();
+        cv.notify_all();
+        return item;
+    }
+
+    void close() {
+        {
+            std::unique_lock lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+struct Rendition {
+    RenditionSpec spec;
+    int width = 0;
+    std::string name;           // "720p"
+    SegmenterOptions opts;      // dossier et playlist propres à la rendition
+    AVOutputGuard output;
+    AVCodecContext *enc = nullptr;
+    SwsContext *sws = nullptr;
+    std::unique_ptr<Interleaver> interleaver;
+    std::unique_ptr<SegmentCutter> cutter;
+    RenditionQueue queue{RENDITION_QUEUE_CAPACITY};
+    VoidResult result{};
+    uint64_t frames = 0;
+    bool already_ended = false;  // reprise d'une rendition déjà terminée
+
+    Rendition() = default;
+    ~Rendition() {
+        cutter.reset();
+        if (enc) avcodec_free_context(&enc);
+        if (sws) sws_freeContext(sws);
+    }
+    Rendition(const Rendition &) = delete;
+    Rendition &operator=(const Rendition &) = delete;
+};
+
+Result<std::vector<RenditionSpec>> parse_abr_ladder(std::string_view text) {
+    std::vector<RenditionSpec> ladder;
+    for (const std::string &item : split_list(text)) {
+        std::size_t colon = item.find(':');
+        if (colon == std::string::npos) {
+            return std::unexpected(std::format("Rendition invalide '{}' (attendu HAUTEUR:KBPS)", item));
+        }
+        auto height = parse_number<int>(std::string_view(item).substr(0, colon), "abr-ladder");
+        if (!height) return std::unexpected(height.error());
+        auto kbps = parse_number<int64_t>(std::string_view(item).substr(colon + 1), "abr-ladder");
+        if (!kbps) return std::unexpected(kbps.error());
+        if (*height <= 0 || *kbps <= 0) {
+            return std::unexpected(std::format("Rendition invalide '{}'", item));
+        }
+        ladder.push_back(RenditionSpec{*height & ~1, *kbps * 1000});
+    }
+    return ladder;
+}
+
+Result<std::unique_ptr<Rendition>> create_rendition(
+    const SegmenterOptions &opts,
+    const RenditionSpec &spec,
+    std::pair<int, int> frame_size,
+    AVFormatContext *input_ctx,
+    int in_video_idx,
+    int in_audio_idx,
+    IdxQueue &idx_queue,
+    WriteBehindCache *cache,
+    int encoder_threads
+) {
+    auto r = std::make_unique<Rendition>();
+    const AVStream *in_video = input_ctx->streams[in_video_idx];
+    auto [in_width, in_height] = frame_size;
+
+    r->spec = spec;
+    r->name = std::format("{}p", spec.height);
+    r->width = static_cast<int>(std::lround(static_cast<double>(spec.height) * in_width / in_height)) & ~1;
+
+    r->opts = opts;
+    r->opts.output_dir = std::format("{}/{}", opts.output_dir, r->name);
+    r->opts.index_file = std::format("{}/{}", r->opts.output_dir, fs::path(opts.index_file).filename().string());
+    for (std::string &dir : r->opts.shard_dirs) dir = std::format("{}/{}", dir, r->name);
+    for (std::string &uri : r->opts.shard_uris) uri = std::format("{}/{}", uri, r->name);
+
+    std::vector<std::string> dirs = r->opts.shard_dirs;
+    dirs.push_back(r->opts.output_dir);
+    for (const std::string &dir : dirs) {
+        if (std::error_code ec; !fs::is_directory(dir) && !fs::create_directories(dir, ec)) {
+            return std::unexpected(std::format("Impossible de créer '{}': {}", dir, ec.message()));
+        }
+    }
+
+    // encodeur logiciel
+    const AVCodec *codec = avcodec_find_encoder_by_name(opts.abr_encoder.c_str());
+    if (!codec) codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec) return std::unexpected("Aucun encodeur H.264 disponible");
+
+    r->enc = avcodec_alloc_context3(codec);
+    if (!r->enc) return std::unexpected("Impossible d'allouer l'encodeur");
+
+    AVRational fps = in_video->avg_frame_rate.num > 0 ? in_video->avg_frame_rate : AVRational{25, 1};
+    r->enc->width = r->width;
+    r->enc->height = spec.height;
+    r->enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    r->enc->time_base = in_video->time_base;
+    r->enc->framerate = fps;
+    r->enc->sample_aspect_ratio = AVRational{1, 1};
+    r->enc->bit_rate = spec.bitrate;
+    r->enc->rc_max_rate = spec.bitrate * 11 / 10;
+    r->enc->rc_buffer_size = static_cast<int>(spec.bitrate * 2);
+    // GOP long : seules les keyframes forcées aux points de coupe comptent
+    r->enc->gop_size = static_cast<int>(av_q2d(fps) * opts.segment_duration * 4);
+    r->enc->max_b_frames = 2;
+    r->enc->thread_count = encoder_threads;
+    av_opt_set(r->enc->priv_data, "preset", opts.abr_preset.c_str(), 0);
+    av_opt_set(r->enc->priv_data, "forced-idr", "1", 0);
+    av_opt_set(r->enc->priv_data, "x264-params", "scenecut=0", 0);
+
+    if (int ret = avcodec_open2(r->enc, codec, nullptr); ret < 0) {
+        char errbuf[FF_INPUT_BUF_SIZE];
+        av_strerror(ret, errbuf, sizeof(errbuf));
+        return std::unexpected(std::format("Impossible d'ouvrir l'encodeur {}: {}", codec->name, errbuf));
+    }
+
+    // sortie MPEG-TS : vidéo encodée + audio copié
+    auto output = AVOutputGuard::create("mpegts");
+    if (!output) return std::unexpected(output.error());
+    r->output = std::move(*output);
+    AVFormatContext *output_ctx = r->output.ctx;
+
+    AVStream *video = avformat_new_stream(output_ctx, nullptr);
+    if (!video || avcodec_parameters_from_context(video->codecpar, r->enc) < 0) {
+        return std::unexpected("Impossible d'allouer le flux vidéo de la rendition");
+    }
+    video->time_base = r->enc->time_base;
+
+    int out_audio_idx = -1;
+    std::vector<int> stream_ids{in_video_idx};
+    if (in_audio_idx >= 0) {
+        auto audio = add_out_stream(output_ctx, input_ctx->streams[in_audio_idx]);
+        if (!audio) return std::unexpected(audio.error());
+        out_audio_idx = (*audio)->index;
+        stream_ids.push_back(in_audio_idx);
+    }
+
+    std::vector<AVRational> tbs = stream_time_bases(input_ctx);
+    tbs[in_video_idx] = r->enc->time_base;
+    r->interleaver = std::make_unique<Interleaver>(tbs, stream_ids, opts.interleave_max_bytes, opts.interleave_max_delay);
+    r->cutter = std::make_unique<SegmentCutter>(r->opts, tbs, static_cast<uint64_t>(spec.bitrate), output_ctx,
+                                                idx_queue, in_video_idx, in_audio_idx, video->index, out_audio_idx);
+    r->cutter->cache = cache;
+
+    auto takeover = takeover_playlist(r->opts);
+    if (!takeover) return std::unexpected(takeover.error());
+    if (*takeover) {
+        r->already_ended = (*takeover)->ended;
+        r->cutter->resume(**takeover);
+    }
+
+    if (auto opened = r->cutter->open_segment(); !opened) return std::unexpected(opened.error());
+    if (avformat_write_header(output_ctx, nullptr) < 0) {
+        return std::unexpected("Impossible d'écrire l'en-tête MPEG-TS");
+    }
+    if (std::error_code ec; !r->cutter->resumed || !fs::exists(r->cutter->seg_index_file, ec)) {
+        if (auto created = create_segment_index(r->cutter->seg_index_file); !created) {
+            return std::unexpected(created.error());
+        }
+    }
+    return r;
+}
+
+// paquets encodés -> entrelaceur -> découpeur
+void rendition_drain_encoder(Rendition &r, int in_video_idx, bool flush) {
+    AVPacketGuard pkt;
+    while (r.result && avcodec_receive_packet(r.enc, pkt) >= 0) {
+        pkt->stream_index = in_video_idx;
+        r.interleaver->push(pkt.release());
+        pkt = AVPacketGuard();
+    }
+    while (r.result) {
+        AVPacket *ready = r.interleaver->pop(flush);
+        if (!ready) break;
+        r.result = r.cutter->write(ready);
+        av_packet_free(&ready);
+    }
+}
+
+void thread_rendition(Rendition &r, int in_video_idx) {
+    ThreadAttach attach(r.name);
+    auto pop = [&r] {
+        ActivityScope wait(ThreadActivity::Waiting);
+        return r.queue.pop();
+    };
+    while (auto item = pop()) {
+        // en erreur, on continue de vider la file pour ne pas bloquer le décodeur
+        if (!r.result) {
+            item->release();
+            continue;
+        }
+        if (item->pkt) {
+            r.interleaver->push(std::exchange(item->pkt, nullptr));
+            rendition_drain_encoder(r, in_video_idx, false);
+            continue;
+        }
+
+        AVFrame *src = item->frame;
+        if (!r.sws) {
+            r.sws = sws_getContext(src->width, src->height, static_cast<AVPixelFormat>(src->format),
+                                   r.width, r.spec.height, AV_PIX_FMT_YUV420P, SWS_BICUBIC,
+                                   nullptr, nullptr, nullptr);
+        }
+        AVFrame *dst = av_frame_alloc();
+        if (!r.sws || !dst) {
+            r.result = std::unexpected(std::format("[{}] Impossible de préparer la mise à l'échelle", r.name));
+        } else {
+            dst->width = r.width;
+            dst->height = r.spec.height;
+            dst->format = AV_PIX_FMT_YUV420P;
+            if (av_frame_get_buffer(dst, 0) < 0) {
+                r.result = std::unexpected(std::format("[{}] Impossible d'allouer l'image", r.name));
+            } else {
+                sws_scale(r.sws, src->data, src->linesize, 0, src->height, dst->data, dst->linesize);
+                dst->pts = src->best_effort_timestamp;
+                dst->pict_type = item->force_key ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+                if (avcodec_send_frame(r.enc, dst) < 0) {
+                    r.result = std::unexpected(std::format("[{}] Échec de l'encodage", r.name));
+                }
+                r.frames++;
+            }
+        }
+        av_frame_free(&dst);
+        item->release();
+        rendition_drain_encoder(r, in_video_idx, false);
+    }
+
+    // bloqué (chien de garde) : pas d'ENDLIST, la reprise continue la playlist
+    bool stalled = r.cutter->progress && r.cutter->progress->abort;
+    if (r.result && !stalled) {
+        avcodec_send_frame(r.enc, nullptr);
+        rendition_drain_encoder(r, in_video_idx, true);
+        if (r.result) r.result = r.cutter->finish();
+    }
+    std::println("[{}] Terminé : {} images, {} segments", r.name, r.frames, r.cutter->output_idx);
+}
+
+Result<void> write_master_playlist(
+    const std::string &path,
+    const std::vector<std::unique_ptr<Rendition>> &renditions,
+    int64_t audio_bitrate
+) {
+    std::string tmp_path = unique_tmp_path(path);
+    FILE *fp = fopen(tmp_path.c_str(), "w");
+    if (!fp) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}' pour écriture: {}", tmp_path, std::strerror(errno)));
+    }
+    std::print(fp, "#EXTM3U\n#EXT-X-VERSION:3\n");
+    for (const auto &r : renditions) {
+        std::print(fp, "#EXT-X-STREAM-INF:BANDWIDTH={},RESOLUTION={}x{}\n{}/{}\n",
+                   r->spec.bitrate + audio_bitrate, r->width, r->spec.height,
+                   r->name, fs::path(r->opts.index_file).filename().string());
+    }
+    fclose(fp);
+
+    if (std::error_code ec; (fs::rename(tmp_path, path, ec), ec)) {
+        return std::unexpected(std::format("Impossible de renommer '{}' vers '{}'", tmp_path, path));
+    }
+    return {};
+}
+
+// Entrée qui n'annonce pas ses dimensions (stdin, flux direct) : un décodeur
+// jetable décode jusqu'à la première image. Les paquets lus sont gardés dans
+// l'ordre, horodatés, et rejoués par le pipeline avant ceux du lecteur.
+constexpr int FRAME_SIZE_PROBE_PACKETS = 2000;
+
+Result<std::pair<int, int>> probe_frame_size(AVFormatContext *input_ctx, int in_video_idx, int in_audio_idx,
+                                             std::deque<AVPacket *> &primed) {
+    const AVCodecParameters *par = input_ctx->streams[in_video_idx]->codecpar;
+    if (par->width > 0 && par->height > 0) return std::pair{par->width, par->height};
+
+    const AVCodec *decoder = avcodec_find_decoder(par->codec_id);
+    if (!decoder) return std::unexpected("Aucun décodeur pour le flux vidéo");
+    std::unique_ptr<AVCodecContext, void (*)(AVCodecContext *)> dec(
+        avcodec_alloc_context3(decoder), [](AVCodecContext *c) { avcodec_free_context(&c); });
+    if (!dec || avcodec_parameters_to_context(dec.get(), par) < 0 || avcodec_open2(dec.get(), decoder, nullptr) < 0) {
+        return std::unexpected("Impossible d'ouvrir le décodeur de sondage");
+    }
+    std::unique_ptr<AVFrame, void (*)(AVFrame *)> frame(av_frame_alloc(), [](AVFrame *f) { av_frame_free(&f); });
+    if (!frame) return std::unexpected("Impossible d'allouer AVFrame");
+
+    for (int read = 0; read < FRAME_SIZE_PROBE_PACKETS; read++) {
+        AVPacket *pkt = av_packet_alloc();
+        if (!pkt) return std::unexpected("Impossible d'allouer AVPacket");
+        if (av_read_frame(input_ctx, pkt) < 0) {
+            av_packet_free(&pkt);
+            break;
+        }
+        if (pkt->stream_index != in_video_idx && pkt->stream_index != in_audio_idx) {
+            av_packet_free(&pkt);
+            continue;
+        }
+        stamp_arrival(pkt, monotonic_ns());
+        primed.push_back(pkt);
+        if (pkt->stream_index != in_video_idx || avcodec_send_packet(dec.get(), pkt) < 0) continue;
+        if (avcodec_receive_frame(dec.get(), frame.get()) >= 0 && frame->width > 0 && frame->height > 0) {
+            std::println("[ABR] Dimensions de la première image : {}x{}", frame->width, frame->height);
+            return std::pair{frame->width, frame->height};
+        }
+    }
+    return std::unexpected("Dimensions vidéo inconnues : aucune image décodée");
+}
+
+VoidResult segment_video_abr(const SegmenterOptions &opts, AVFormatContext *input_ctx,
+                             int in_video_idx, int in_audio_idx,
+                             Watchdog *watchdog, std::optional<double> resume_from) {
+    AVStream *in_video = input_ctx->streams[in_video_idx];
+
+    const AVCodec *decoder = avcodec_find_decoder(in_video->codecpar->codec_id);
+    if (!decoder) return std::unexpected("Aucun décodeur pour le flux vidéo");
+    std::unique_ptr<AVCodecContext, void (*)(AVCodecContext *)> dec(
+        avcodec_alloc_context3(decoder), [](AVCodecContext *c) { avcodec_free_context(&c); });
+    if (!dec || avcodec_parameters_to_context(dec.get(), in_video->codecpar) < 0) {
+        return std::unexpected("Impossible de préparer le décodeur");
+    }
+    dec->thread_count = 0;
+    if (avcodec_open2(dec.get(), decoder, nullptr) < 0) {
+        return std::unexpected("Impossible d'ouvrir le décodeur");
+    }
+
+    IdxQueue idx_queue;
+    std::unique_ptr<WriteBehindCache> cache;
+    if (opts.write_behind_bytes > 0) {
+        cache = std::make_unique<WriteBehindCache>(opts.write_behind_bytes, opts.writer_threads);
+    }
+    int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int encoder_threads = std::max(1, cores / static_cast<int>(opts.abr_ladder.size()));
+
+    // paquets lus par le sondage des dimensions, libérés s'ils ne sont pas rejoués
+    struct PrimedPackets {
+        std::deque<AVPacket *> pkts;
+        ~PrimedPackets() {
+            for (AVPacket *pkt : pkts) av_packet_free(&pkt);
+        }
+    } primed;
+    auto frame_size = probe_frame_size(input_ctx, in_video_idx, in_audio_idx, primed.pkts);
+    if (!frame_size) return std::unexpected(frame_size.error());
+
+    std::vector<std::unique_ptr<Rendition>> renditions;
+    for (const RenditionSpec &spec : opts.abr_ladder) {
+        auto r = create_rendition(opts, spec, *frame_size, input_ctx, in_video_idx, in_audio_idx, idx_queue, cache.get(), encoder_threads);
+        if (!r) return std::unexpected(r.error());
+        if (watchdog) (*r)->cutter->progress = &watchdog->progress;
+        (*r)->cutter->resume_from = resume_from;
+        std::println("Rendition {} : {}x{} @ {} kbit/s", (*r)->name, (*r)->width, spec.height, spec.bitrate / 1000);
+        renditions.push_back(std::move(*r));
+    }
+    if (std::ranges::any_of(renditions, &Rendition::already_ended)) {
+        std::println("[Reprise] Le flux a déjà été terminé par le propriétaire précédent");
+        return {};
+    }
+
+    int64_t audio_bitrate = 0;
+    if (in_audio_idx >= 0) {
+        audio_bitrate = input_ctx->streams[in_audio_idx]->codecpar->bit_rate;
+        if (audio_bitrate <= 0) audio_bitrate = 128000;
+    }
+    if (auto master = write_master_playlist(opts.index_file, renditions, audio_bitrate); !master) {
+        return std::unexpected(master.error());
+    }
+
+    PacketQueue queue(opts.queue_capacity, opts.queue_bytes);
+    if (watchdog) watchdog->queue = &queue;
+    StatusWatch status_watch(&queue, &idx_queue, cache.get());
+    std::thread reader(thread_reader, input_ctx, in_video_idx, in_audio_idx, std::ref(queue),
+                       watchdog ? &watchdog->progress : nullptr);
+    std::thread idx_writer(thread_idx_writer, std::ref(idx_queue), opts.latency_slo);
+    std::vector<std::thread> workers;
+    for (auto &r : renditions) workers.emplace_back(thread_rendition, std::ref(*r), in_video_idx);
+
+    // points de coupe communs : keyframe forcée tous les segment_duration
+    const double video_tb = av_q2d(in_video->time_base);
+    const double half_frame = in_video->avg_frame_rate.num > 0 ? 0.5 / av_q2d(in_video->avg_frame_rate) : 0.02;
+    std::optional<double> next_cut;
+
+    VoidResult result{};
+    AVFrame *frame = av_frame_alloc();
+    if (!frame) result = std::unexpected("Impossible d'allouer AVFrame");
+
+    auto fan_out_frames = [&] {
+        while (result && avcodec_receive_frame(dec.get(), frame) >= 0) {
+            if (frame->best_effort_timestamp == AV_NOPTS_VALUE) {
+                av_frame_unref(frame);
+                continue;
+            }
+            double t = frame->best_effort_timestamp * video_tb;
+            if (resume_from && t < *resume_from - half_frame) {
+                av_frame_unref(frame);
+                continue;
+            }
+            bool force = false;
+            if (!next_cut || t >= *next_cut - half_frame) {
+                force = true;
+                double base = next_cut ? *next_cut : t;
+                next_cut = base + opts.segment_duration;
+                while (t >= *next_cut - half_frame) *next_cut += opts.segment_duration;
+            }
+            for (auto &r : renditions) {
+                r->queue.push(RenditionItem{av_frame_clone(frame), nullptr, force});
+            }
+            av_frame_unref(frame);
+        }
+    };
+
+    while (result) {
+        AVPacket *pkt = nullptr;
+        if (!primed.pkts.empty()) {
+            pkt = primed.pkts.front();
+            primed.pkts.pop_front();
+        } else {
+            pkt = queue.pop();
+        }
+        if (!pkt) break;
+
+        if (pkt->stream_index == in_video_idx) {
+            if (avcodec_send_packet(dec.get(), pkt) < 0) {
+                std::println(stderr, "[Décodeur] Paquet vidéo ignoré");
+            }
+            av_packet_free(&pkt);
+            fan_out_frames();
+        } else {
+            for (std::size_t i = 1; i < renditions.size(); i++) {
+                renditions[i]->queue.push(RenditionItem{nullptr, copy_arrival(av_packet_clone(pkt), pkt), false});
+            }
+            renditions[0]->queue.push(RenditionItem{nullptr, pkt, false});
+        }
+        if (watchdog) StageProgress::touch(watchdog->progress.last_mux);
+    }
+    queue.close();
+    reader.join();
+
+    // bloqué : ni vidage ni ENDLIST, la reprise repartira du dernier segment publié
+    if (result && watchdog && watchdog->fired()) {
+        result = std::unexpected(std::format("Blocage à l'étape '{}'", watchdog->progress.stalled_stage));
+    }
+
+    if (result) {
+        avcodec_send_packet(dec.get(), nullptr);
+        fan_out_frames();
+    }
+    av_frame_free(&frame);
+
+    for (auto &r : renditions) r->queue.close();
+    for (std::thread &w : workers) w.join();
+    idx_queue.close();
+    idx_writer.join();
+
+    for (auto &r : renditions) {
+        if (result && !r->result) result = std::unexpected(std::format("[{}] {}", r->name, r->result.error()));
+    }
+    if (cache) cache->print_summary("Cache");
+    if (result) {
+        std::println("Segmentation ABR terminée : {} renditions", renditions.size());
+    }
+    return result;
+}
+
+// Compteurs matériels (perf_event_open) autour de la boucle de segmentation.
+// Ouverts sur le thread principal avec inherit : les threads lancés ensuite
+// (lecteur, index, cache) sont comptés quand ils ont été joints. Un compteur
+// refusé (perf_event_paranoid, VM) est affiché n/a sans faire échouer le job.
+struct PerfCounters {
+    struct Counter {
+        const char *name;
+        uint32_t type;
+        uint64_t config;
+        int fd = -1;
+        std::optional<uint64_t> value;
+    };
+
+    std::vector<Counter> counters;
+    std::chrono::steady_clock::time_point started;
+    double seconds = 0.0;
+
+    PerfCounters() {
+#ifdef __linux__
+        counters = {
+            {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, {}},
+            {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, {}},
+            {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1, {}},
+            {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, {}},
+            {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, -1, {}},
+        };
+#endif
+    }
+    ~PerfCounters() {
+        for (Counter &c : counters) {
+            if (c.fd >= 0) ::close(c.fd);
+        }
+    }
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    void start() {
+#ifdef __linux__
+        for (Counter &c : counters) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = c.type;
+            attr.config = c.config;
+            attr.disabled = 1;
+            attr.inherit = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            c.fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+            if (c.fd < 0) {
+                std::println(stderr, "[Perf] {} indisponible: {}", c.name, std::strerror(errno));
+                continue;
+            }
+            ioctl(c.fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(c.fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#else
+        std::println(stderr, "[Perf] perf_event_open indisponible sur ce système");
+#endif
+        started = std::chrono::steady_clock::now();
+    }
+
+    // à appeler une fois les threads fils joints
+    void stop() {
+        seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+#ifdef __linux__
+        for (Counter &c : counters) {
+            if (c.fd < 0) continue;
+            ioctl(c.fd, PERF_EVENT_IOC_DISABLE, 0);
+            uint64_t data[3] = {};  // valeur, temps activé, temps compté
+            if (read(c.fd, data, sizeof(data)) == static_cast<ssize_t>(sizeof(data)) && data[2] > 0) {
+                // multiplexage : extrapole sur le temps activé
+                c.value = static_cast<uint64_t>(static_cast<double>(data[0]) * data[1] / data[2]);
+            }
+        }
+#endif
     }
 
-    void close() {
-       {
-           std::unique_lock lock(mtx);
-           closed = true;
-       }
-        cv.notify_all();
+    [[nodiscard]] std::optional<uint64_t> get(std::string_view name) const {
+        for (const Counter &c : counters) {
+            if (name == c.name) return c.value;
+        }
+        return std::nullopt;
     }
 
-    [[nodiscard]] std::size_t size () {
-        std::unique_lock lock(mtx);
-        return tasks.size();
+    void print(uint64_t packets, uint64_t bytes) const {
+        double mb = static_cast<double>(bytes) / (1024.0 * 1024.0);
+        std::println("[Perf] {} paquets, {:.1f} Mo en {:.3f} s ({:.1f} Mo/s, {:.0f} paquets/s)",
+                     packets, mb, seconds, seconds > 0 ? mb / seconds : 0.0,
+                     seconds > 0 ? static_cast<double>(packets) / seconds : 0.0);
+        for (const Counter &c : counters) {
+            if (!c.value) {
+                std::println("[Perf] {:<17} n/a", c.name);
+                continue;
+            }
+            auto v = static_cast<double>(*c.value);
+            std::println("[Perf] {:<17} {:>15}  {:>12.1f} /paquet  {:>14.1f} /Mo",
+                         c.name, *c.value, packets ? v / static_cast<double>(packets) : 0.0, mb > 0 ? v / mb : 0.0);
+        }
+        auto cycles = get("cycles");
+        auto instructions = get("instructions");
+        if (cycles && instructions && *cycles > 0) {
+            std::println("[Perf] IPC {:.2f}", static_cast<double>(*instructions) / static_cast<double>(*cycles));
+        }
     }
 };
 
+// Reprise (--resume) : repositionne l'entrée sur la fin du dernier segment de
+// l'index binaire. Une entrée non seekable (pipe, direct) repart où elle en est.
+std::optional<double> seek_to_checkpoint(const SegmenterOptions &opts, AVFormatContext *input_ctx) {
+    if (!opts.resume) return std::nullopt;
+    fs::path playlist = opts.index_file;
+    if (!opts.abr_ladder.empty()) {
+        playlist = fs::path(opts.output_dir) / std::format("{}p", opts.abr_ladder.front().height) / playlist.filename();
+    }
+    auto record = last_segment_record(playlist.replace_extension(".idx").string());
+    if (!record) {
+        std::println("[Reprise] Pas de point de reprise ({}), départ du début", record.error());
+        return std::nullopt;
+    }
 
+    double checkpoint = static_cast<double>(record->start_pts + record->duration) / SEGIDX_CLOCK;
+    auto ts = static_cast<int64_t>(checkpoint * AV_TIME_BASE);
+    if (avformat_seek_file(input_ctx, -1, INT64_MIN, ts, ts, 0) < 0) {
+        std::println(stderr, "[Reprise] Entrée non seekable, reprise au point courant");
+        return std::nullopt;
+    }
+    std::println("[Reprise] Entrée repositionnée à {:.3f} s (après le segment {})", checkpoint, record->sequence);
+    return checkpoint;
+}
 
-// @see https://github.com/catchorg/Catch2/issues/929#issuecomment-308663820
-// @see https://github.com/catchorg/Catch2/issues/929#issuecomment-308663820
-#define CHECK(cond, msg, ...)                                     \
-do {                                                          \
-    if (cond) {                                               \
-        fprintf(stderr, "Erreur: " msg "\n", ##__VA_ARGS__); \
-        ret = SEG_ERR;                                        \
-        goto cleanup;                                         \
-    }                                                         \
-} while((void)0, 0)
+VoidResult segment_video(const SegmenterOptions &opts, Watchdog *watchdog, const AVIOInterruptCB *interrupt);
 
+VoidResult segment_video(const SegmenterOptions &opts, bool *stalled) {
+    // avant l'ouverture : l'AVIOContext d'entrée recopie le callback d'interruption
+    std::unique_ptr<Watchdog> watchdog;
+    if (opts.stall_timeout > 0.0) {
+        double timeout = opts.stall_timeout + (opts.follow ? opts.follow->idle_timeout : 0.0);
+        watchdog = std::make_unique<Watchdog>(timeout, opts.segment_duration);
+    }
+    AVIOInterruptCB interrupt{};
+    if (watchdog) interrupt = watchdog->progress.callback();
 
+    VoidResult result = segment_video(opts, watchdog.get(), watchdog ? &interrupt : nullptr);
+    if (!result && watchdog && watchdog->fired() && stalled) *stalled = true;
+    return result;
+}
 
+// ouvre et vérifie l'entrée de secours; nullopt (avec avertissement) si elle est
+// inutilisable, le primaire tourne alors seul
+std::optional<AVInputGuard> open_backup_input(const SegmenterOptions &opts, const AVFormatContext *primary,
+                                              int video_idx, int audio_idx, const AVIOInterruptCB &interrupt,
+                                              int &backup_video, int &backup_audio) {
+    auto backup = AVInputGuard::open(opts.backup_input, opts.input_format, std::nullopt, &interrupt);
+    if (!backup) {
+        std::println(stderr, "[Secours] {} ; pas de bascule possible", backup.error());
+        return std::nullopt;
+    }
+    if (avformat_find_stream_info(backup->ctx, nullptr) < 0) {
+        std::println(stderr, "[Secours] Infos. des flux illisibles ; pas de bascule possible");
+        return std::nullopt;
+    }
+    find_av_streams(backup->ctx, backup_video, backup_audio);
+    // le muxer est figé sur les paramètres du primaire : même codec obligatoire
+    const AVCodecParameters *video = primary->streams[video_idx]->codecpar;
+    if (backup_video < 0 || backup->ctx->streams[backup_video]->codecpar->codec_id != video->codec_id) {
+        std::println(stderr, "[Secours] Vidéo absente ou d'un autre codec ; pas de bascule possible");
+        return std::nullopt;
+    }
+    if (audio_idx >= 0 && backup_audio >= 0 &&
+        backup->ctx->streams[backup_audio]->codecpar->codec_id != primary->streams[audio_idx]->codecpar->codec_id) {
+        std::println(stderr, "[Secours] Audio d'un autre codec, ignoré après bascule");
+        backup_audio = -1;
+    }
+    if (audio_idx < 0) backup_audio = -1;
+    std::println("[Secours] '{}' prêt ({} flux)", opts.backup_input, backup->ctx->nb_streams);
+    return std::move(*backup);
+}
 
+VoidResult segment_video(const SegmenterOptions &opts, Watchdog *watchdog, const AVIOInterruptCB *interrupt) {
+    // avec un secours, le primaire doit pouvoir être abandonné en pleine lecture
+    std::unique_ptr<FailoverSource> failover;
+    AVIOInterruptCB primary_interrupt{};
+    if (!opts.backup_input.empty()) {
+        failover = std::make_unique<FailoverSource>(opts.queue_capacity, opts.failover_timeout,
+                                                    watchdog ? &watchdog->progress : nullptr);
+        primary_interrupt = failover->primary_callback();
+        interrupt = &primary_interrupt;
+    }
 
+    auto input = AVInputGuard::open(opts.input_file, opts.input_format, opts.follow, interrupt);
+    if (!input) return std::unexpected(input.error());
+    AVFormatContext *input_ctx = input->ctx;
 
+    if (avformat_find_stream_info(input_ctx, nullptr) < 0) {
+        return std::unexpected("Impossible de lire les infos. des flux");
+    }
 
-static SegResult segment_video(
-const char *input_file,
-const char *base_dirpath,
-const char *output_idx_file,
-const char *base_file_name,
-const char *base_file_ext,
-int segment_length,
-int max_list_length) {
-    AVFormatContext *input_ctx = NULL;
-    AVFormatContext *output_ctx = NULL;
-    AVPacket *pkt = NULL;
-    SegResult ret = SEG_OK;
+    int in_video_idx = -1;
+    int in_audio_idx = -1;
+    find_av_streams(input_ctx, in_video_idx, in_audio_idx);
+    if (in_video_idx < 0) return std::unexpected("Aucun flux vidéo trouvé");
+    std::println("Flux vidéo : idx {}", in_video_idx);
+    if (in_audio_idx >= 0) std::println("Flux audio : idx {}", in_audio_idx);
 
-    char current_file_name[MAX_FILENAME_LENGTH];
-    char tmp_idx_file[MAX_FILENAME_LENGTH];
-    unsigned int durations[MAX_SEGMENTS + 1];
-    unsigned int max_duration = 0;
-    unsigned int num_segments = 0;
-    unsigned int output_idx = 1;
-    unsigned int list_offset = 1;
+    // un seul processus écrit dans le dossier; en secours on attend le verrou,
+    // l'entrée déjà ouverte pour reprendre sans délai
+    if (watchdog && opts.standby) watchdog->pause();
+    auto lock = StreamLock::acquire(opts.output_dir, opts.standby);
+    if (watchdog && opts.standby) watchdog->unpause();
+    if (!lock) return std::unexpected(lock.error());
+    if (opts.standby) std::println("[Secours] Dossier '{}' repris", opts.output_dir);
 
-    double segment_start = 0.0;
-    double pkt_time = 0.0;
-    double prev_pkt_time = 0.0;
+    std::optional<double> resume_from = seek_to_checkpoint(opts, input_ctx);
 
-    int input_video_idx = -1;
-    int input_audio_idx = -1;
-    int output_video_idx = -1;
-    int output_audio_idx = -1;
-    int wait_first_keyframe = 1;
+    if (!opts.abr_ladder.empty()) {
+        return segment_video_abr(opts, input_ctx, in_video_idx, in_audio_idx, watchdog, resume_from);
+    }
 
-    snprintf(tmp_idx_file, MAX_FILENAME_LENGTH, "%s.tmp", output_idx_file);
+    // sans secours utilisable, failover reste en vie : le callback du primaire le référence
+    std::optional<AVInputGuard> backup;
+    int backup_video = -1;
+    int backup_audio = -1;
+    if (failover) {
+        backup = open_backup_input(opts, input_ctx, in_video_idx, in_audio_idx, failover->backup_callback(),
+                                   backup_video, backup_audio);
+    }
+    FailoverSource *source = backup ? failover.get() : nullptr;
 
-    int ff_ret = avformat_open_input(&input_ctx, input_file, NULL, NULL);
-    if (ff_ret < 0) {
-        char errbuf[FF_INPUT_BUF_SIZE];
-        av_strerror(ff_ret, errbuf, sizeof(errbuf));
-        fprintf(stderr, "Erreur : Impossible d'ouvrir '%s' : %s\n", input_file, errbuf);
-        return SEG_ERR;
+    auto output = AVOutputGuard::create("mpegts");
+    if (!output) return std::unexpected(output.error());
+    AVFormatContext *output_ctx = output->ctx;
+
+    auto video_stream = add_out_stream(output_ctx, input_ctx->streams[in_video_idx]);
+    if (!video_stream) return std::unexpected(video_stream.error());
+    int out_video_idx = (*video_stream)->index;
+
+    int out_audio_idx = -1;
+    std::vector<int> stream_ids{in_video_idx};
+    if (in_audio_idx >= 0) {
+        auto audio_stream = add_out_stream(output_ctx, input_ctx->streams[in_audio_idx]);
+        if (!audio_stream) return std::unexpected(audio_stream.error());
+        out_audio_idx = (*audio_stream)->index;
+        stream_ids.push_back(in_audio_idx);
     }
-    CHECK(avformat_find_stream_info(input_ctx, NULL) < 0, "Impossible de lire les infos. des flux");
 
-    // détecte des flux vidéo/audio
-    for (unsigned int i = 0; i < input_ctx->nb_streams; i++) {
-        enum AVMediaType type = input_ctx->streams[i]->codecpar->codec_type;
-        if (type == AVMEDIA_TYPE_VIDEO && input_video_idx < 0) input_video_idx = i;
-        if (type == AVMEDIA_TYPE_AUDIO && input_audio_idx < 0) input_audio_idx = i;
+    // avant tout thread, pour qu'ils héritent des compteurs
+    PerfCounters perf;
+    if (opts.perf_counters) perf.start();
+
+    PacketQueue queue(opts.queue_capacity, opts.queue_bytes);
+    IdxQueue idx_queue;
+    std::unique_ptr<WriteBehindCache> cache;
+    if (opts.write_behind_bytes > 0) {
+        cache = std::make_unique<WriteBehindCache>(opts.write_behind_bytes, opts.writer_threads);
+    }
+    StatusWatch status_watch(&queue, &idx_queue, cache.get());
+    Interleaver interleaver(stream_time_bases(input_ctx), stream_ids, opts.interleave_max_bytes, opts.interleave_max_delay);
+    SegmentCutter cutter(opts, stream_time_bases(input_ctx), input_ctx->bit_rate > 0 ? input_ctx->bit_rate : 0,
+                         output_ctx, idx_queue, in_video_idx, in_audio_idx, out_video_idx, out_audio_idx);
+    cutter.cache = cache.get();
+    cutter.resume_from = resume_from;
+    if (watchdog) {
+        cutter.progress = &watchdog->progress;
+        watchdog->queue = &queue;
     }
-    CHECK(input_video_idx < 0, "Aucun flux vidéo trouvé");
-    printf("Flux vidéo : idx %d\n", input_video_idx);
-    if (input_audio_idx >= 0) printf("Flux audio : idx %d\n", input_audio_idx);
 
-    CHECK(avformat_alloc_output_context2(&output_ctx, NULL, "mpegts", NULL) < 0, "Impossible d'allouer le ctx de sortie");
+    auto takeover = takeover_playlist(opts);
+    if (!takeover) return std::unexpected(takeover.error());
+    if (*takeover) {
+        if ((*takeover)->ended) {
+            std::println("[Reprise] Le flux a déjà été terminé par le propriétaire précédent");
+            return {};
+        }
+        cutter.resume(**takeover);
+    }
 
-    AVStream *output_video_stream = add_out_stream(output_ctx, input_ctx->streams[input_video_idx]);
-    CHECK(!output_video_stream, "Impossible d'allouer le stream");
-    output_video_idx = output_video_stream->index;
+    if (auto opened = cutter.open_segment(); !opened) {
+        return opened;
+    }
+    if (avformat_write_header(output_ctx, nullptr) < 0) {
+        return std::unexpected("Impossible d'écrire l'en-tête MPEG-TS");
+    }
 
-    AVStream *output_audio_stream = NULL;
-    if (input_audio_idx >= 0) {
-        output_audio_stream = add_out_stream(output_ctx, input_ctx->streams[input_audio_idx]);
-        CHECK(!output_video_stream, "Impossible d'allouer le stream");
-        output_audio_idx = output_audio_stream->index;
+    if (std::error_code ec; !cutter.resumed || !fs::exists(cutter.seg_index_file, ec)) {
+        if (auto created = create_segment_index(cutter.seg_index_file); !created) {
+            return std::unexpected(created.error());
+        }
     }
 
-    CHECK(open_next_segment(
-        output_ctx, current_file_name, MAX_FILENAME_LENGTH, base_dirpath, base_file_name, output_idx, base_file_ext)
-        != SEG_OK, "Impossible d'ouvrir le premier segment");
+    std::unique_ptr<ThumbnailPool> thumbnails;
+    if (opts.thumbnails) {
+        thumbnails = std::make_unique<ThumbnailPool>(opts, input_ctx->streams[in_video_idx]);
+        cutter.thumbnails = thumbnails.get();
+    }
 
-    if (avformat_write_header(output_ctx, NULL) < 0) {
-        avio_closep(&output_ctx->pb);
-        CHECK(1, "Impossible d'écrire l'en-tête MPEG-TS");
+    std::thread reader(thread_reader, input_ctx, in_video_idx, in_audio_idx, std::ref(queue),
+                       watchdog ? &watchdog->progress : nullptr);
+    std::thread standby_reader;
+    if (source) {
+        source->start(queue, stream_time_bases(input_ctx));
+        standby_reader = std::thread(&FailoverSource::read_backup, source, backup->ctx,
+                                     backup_video, backup_audio, in_video_idx, in_audio_idx);
     }
-    const double video_pts2time = av_q2d(input_ctx->streams[input_video_idx]->time_base);
-    // alloc packet
-    pkt = av_packet_alloc();
-    CHECK(!pkt, "Impossible d'allouer AVPacket");
+    std::thread idx_writer(thread_idx_writer, std::ref(idx_queue), opts.latency_slo);
 
-    while (av_read_frame(input_ctx, pkt) >= 0) {
-        int is_keyframe = 0;
-        int orginal_stream_idx = pkt->stream_index;
+    VoidResult result{};
+    auto drain = [&](bool flush) {
+        while (result) {
+            AVPacket *ready = interleaver.pop(flush);
+            if (!ready) break;
+            result = cutter.write(ready);
+            av_packet_free(&ready);
+        }
+    };
 
-        if (pkt->stream_index == orginal_stream_idx) {
-            pkt_time = pkt->pts * video_pts2time;
-            is_keyframe = pkt->flags & AV_PKT_FLAG_KEY;
-            if (is_keyframe && wait_first_keyframe) {
-                wait_first_keyframe = 0;
-                prev_pkt_time = pkt_time;
-                segment_start = pkt_time;
-            }
-            pkt->stream_index = output_video_idx;
-        } else if (pkt->stream_index == input_audio_idx && output_audio_stream) {
-            pkt->stream_index = output_audio_idx;
-        } else {
-            av_packet_unref(pkt);
-            continue;
+    uint64_t packets = 0;
+    uint64_t packet_bytes = 0;
+    StatusBoard &board = StatusBoard::instance();
+    ThreadAttach attach("muxer");
+    StagePin pin(PipelineStage::Muxer);
+    auto next_packet = [&](bool &switched) {
+        ActivityScope wait(ThreadActivity::Waiting);
+        return source ? source->next(switched) : queue.pop();
+    };
+    while (result) {
+        bool switched = false;
+        AVPacket *pkt = next_packet(switched);
+        if (switched) {
+            // tout le primaire sort avant le premier paquet du secours
+            drain(true);
+            if (result) result = cutter.discontinuity();
+        }
+        if (!pkt) break;
+        if (!result) {
+            av_packet_free(&pkt);
+            break;
         }
+        packets++;
+        packet_bytes += pkt->size;
+        interleaver.push(pkt);
+        drain(false);
+        if (watchdog) StageProgress::touch(watchdog->progress.last_mux);
+        board.note_progress(cutter.output_idx, cutter.pkt_time - cutter.segment_start, interleaver.bytes,
+                            cutter.writer ? cutter.writer->buffered_bytes() : 0);
+    }
+    queue.close();
+    if (failover) failover->stop();
+    reader.join();
+    if (standby_reader.joinable()) standby_reader.join();
 
-        if (wait_first_keyframe) {
-            av_packet_unref(pkt);
-            continue;
+    // bloqué : ni vidage ni ENDLIST, la reprise repartira du dernier segment publié
+    if (result && watchdog && watchdog->fired()) {
+        result = std::unexpected(std::format("Blocage à l'étape '{}'", watchdog->progress.stalled_stage));
+    }
+
+    if (result) {
+        drain(true);
+        if (result) result = cutter.finish();
+    }
+    idx_queue.close();
+    idx_writer.join();
+    if (!result) board.set_error(result.error());
+    if (thumbnails && result) thumbnails->finish(cutter.pkt_time);
+    if (opts.perf_counters) {
+        if (cache) cache->close();
+        perf.stop();
+    }
+
+    std::println("[Entrelaceur] pic {} Ko, {} sorties forcées", interleaver.peak_bytes / 1024, interleaver.forced);
+    if (cache) cache->print_summary("Cache");
+    if (opts.perf_counters) perf.print(packets, packet_bytes);
+    std::println("[Sortie] {} write syscalls, {:.1f} par segment, {} Ko par syscall",
+                 cutter.total_syscalls, static_cast<double>(cutter.total_syscalls) / cutter.output_idx,
+                 cutter.total_syscalls ? cutter.total_bytes / cutter.total_syscalls / 1024 : 0);
+    cutter.close_latency.print(cutter.total_bytes);
+    if (result) {
+        std::println("Segmentation finished successfully : {} segments created", cutter.output_idx);
+    }
+    return result;
+}
+
+// Ingestion multi-chaînes (--channels) : input_file liste les chaînes, une par
+// ligne "nom entrée [format]". Toutes les entrées (udp://adresse:port,
+// unix:/socket, pipe:N, FIFO) sont lues en non bloquant par une seule boucle
+// epoll qui remplit un anneau par chaîne ; un petit pool de workers démuxe et
+// segmente les chaînes qui ont assez d'avance. Une chaîne muette ne coûte que
+// son anneau et son démuxeur, sans thread ni réveil.
+constexpr std::size_t CHANNEL_AVIO_BUFFER_SIZE = 32 * 1024;
+constexpr std::size_t CHANNEL_BUFFER_MIN = 256 * 1024;
+constexpr std::size_t CHANNEL_READ_BATCH = 64;       // paquets par passage avant de rendre la main
+constexpr std::size_t CHANNEL_MAX_DATAGRAM = 64 * 1024;
+constexpr double CHANNEL_READ_TIMEOUT = 10.0;        // s d'attente d'un paquet à cheval
+
+struct ChannelSpec {
+    std::string name;
+    std::string input;
+    std::string format;
+};
+
+Result<std::vector<ChannelSpec>> read_channel_list(const std::string &path) {
+    std::ifstream in(path);
+    if (!in) return std::unexpected(std::format("Impossible de lire la liste de chaînes '{}'", path));
+
+    std::vector<ChannelSpec> channels;
+    std::string line;
+    for (int line_no = 1; std::getline(in, line); line_no++) {
+        std::ranges::replace(line, '\t', ' ');
+        std::string_view text = line;
+        text = text.substr(0, text.find('#'));
+        auto fields = split_list(text, ' ');
+        if (fields.empty()) continue;
+        if (fields.size() > 3 || fields.size() < 2) {
+            return std::unexpected(std::format("{}:{} : attendu 'nom entrée [format]'", path, line_no));
         }
-        // @TODO define 0.25
-        // if (is_keyframe && (pkt_time - segment_start) >= segment_length - 0.25)  { avio_flush(...) avio_closep(...) }
-        if (is_keyframe && (pkt_time - segment_start) >= (segment_length - 0.25)) {
-            avio_flush(output_ctx->pb);
-            avio_closep(&output_ctx->pb);
-
-            unsigned int seg_dur = (unsigned int)rint(prev_pkt_time - segment_start);
-            durations[num_segments] = seg_dur;
-            if (seg_dur < max_duration) max_duration = seg_dur;
-            num_segments++;
-
-            char old_filename[MAX_FILENAME_LENGTH];
-            old_filename[0] = '\0';
-            if (max_duration > 0 && num_segments > (unsigned int)max_list_length) {
-                snprintf(old_filename, MAX_FILENAME_LENGTH, "%s/%s-%u%s", base_dirpath, base_file_name, list_offset, base_file_ext);
-                list_offset++;
-                num_segments--;
-                memmove(durations, durations + 1, num_segments * sizeof(durations[0]));
-
-                // cacul (again) max dur only if seg deleted was max
-                if (durations[0] >= max_duration)
-                    max_duration = 0;
-                    for (unsigned int i = 0; i < num_segments; i++)
-                        if (durations[i] > max_duration) max_duration = durations[i];
-            }
-            // write_idx_file
-            write_idx_file(output_idx_file, tmp_idx_file, num_segments, durations, list_offset, base_file_name, base_file_ext, max_duration, 0);
-
-            if (num_segments >= MAX_SEGMENTS)
-                fprintf(stderr, "Too many segments (%u)\n", MAX_SEGMENTS);
-                av_packet_unref(pkt);
-                break;
+        if (fields[0] == "." || fields[0] == ".." || fields[0].find('/') != std::string::npos) {
+            return std::unexpected(std::format("{}:{} : nom de chaîne invalide '{}'", path, line_no, fields[0]));
+        }
+        channels.push_back(ChannelSpec{fields[0], fields[1], fields.size() > 2 ? fields[2] : std::string{}});
+    }
+    if (channels.empty()) return std::unexpected(std::format("Aucune chaîne dans '{}'", path));
+    return channels;
+}
 
-            // open seg next and delete older (unlink diff)
-            if (open_next_segment(output_ctx, current_file_name, MAX_FILENAME_LENGTH, base_dirpath, base_file_name, output_idx + 1, base_file_ext) != SEG_OK) {
-                av_packet_unref(pkt);
+#ifdef __linux__
+// fd non bloquant de l'entrée; datagram = UDP (une lecture = un datagramme)
+Result<int> open_channel_fd(const std::string &input, bool &datagram) {
+    datagram = false;
+    int fd = -1;
+    if (input.starts_with("udp://")) {
+        std::string_view addr = std::string_view(input).substr(6);
+        std::size_t colon = addr.rfind(':');
+        if (colon == std::string_view::npos) return std::unexpected(std::format("Port manquant dans '{}'", input));
+        auto port = parse_number<uint16_t>(addr.substr(colon + 1), "channels");
+        if (!port) return std::unexpected(port.error());
+
+        sockaddr_in sa{};
+        sa.sin_family = AF_INET;
+        sa.sin_port = htons(*port);
+        std::string host(addr.substr(0, colon));
+        if (!host.empty() && inet_pton(AF_INET, host.c_str(), &sa.sin_addr) != 1) {
+            return std::unexpected(std::format("Adresse IPv4 invalide dans '{}'", input));
+        }
+
+        fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (fd < 0) return std::unexpected(std::format("socket '{}': {}", input, std::strerror(errno)));
+        int one = 1;
+        int rcvbuf = 4 * 1024 * 1024;  // absorbe les rafales entre deux passages de la boucle
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+        bool failed = bind(fd, reinterpret_cast<const sockaddr *>(&sa), sizeof(sa)) != 0;
+        if (!failed && IN_MULTICAST(ntohl(sa.sin_addr.s_addr))) {
+            ip_mreq mreq{};
+            mreq.imr_multiaddr = sa.sin_addr;
+            mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+            failed = setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) != 0;
+        }
+        if (failed) {
+            int err = errno;
+            ::close(fd);
+            return std::unexpected(std::format("Impossible d'écouter '{}': {}", input, std::strerror(err)));
+        }
+        datagram = true;
+        return fd;
+    }
+
+    if (input.starts_with("unix:")) {
+        std::string path = input.substr(5);
+        sockaddr_un sa{};
+        sa.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(sa.sun_path)) {
+            return std::unexpected(std::format("Chemin de socket invalide '{}'", input));
+        }
+        std::memcpy(sa.sun_path, path.data(), path.size());
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0 || connect(fd, reinterpret_cast<const sockaddr *>(&sa), sizeof(sa)) != 0) {
+            int err = errno;
+            if (fd >= 0) ::close(fd);
+            return std::unexpected(std::format("Impossible de se connecter à '{}': {}", input, std::strerror(err)));
+        }
+    } else if (input.starts_with("pipe:")) {
+        auto n = parse_number<int>(std::string_view(input).substr(5), "channels");
+        if (!n) return std::unexpected(n.error());
+        fd = *n;
+    } else {
+        // FIFO ouverte sans attendre d'écrivain; les fichiers normaux ne passent pas par epoll
+        struct stat st{};
+        if (stat(input.c_str(), &st) != 0 || !S_ISFIFO(st.st_mode)) {
+            return std::unexpected(std::format("'{}' n'est ni udp://, ni unix:, ni pipe:N, ni une FIFO", input));
+        }
+        fd = ::open(input.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+        if (fd < 0) return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", input, std::strerror(errno)));
+    }
+
+    int flags = fcntl(fd, F_GETFL);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return std::unexpected(std::format("Impossible de rendre '{}' non bloquant: {}", input, std::strerror(errno)));
+    }
+    return fd;
+}
+
+struct Channel {
+    ChannelSpec spec;
+    SegmenterOptions opts;  // propre à la chaîne : le découpeur en garde une référence
+    int fd = -1;
+    bool datagram = false;
+    int epoll_fd = -1;
+
+    // anneau rempli par la boucle epoll, vidé par le callback AVIO du worker
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<uint8_t> ring;
+    std::size_t head = 0;
+    std::size_t size = 0;
+    bool eof = false;
+    bool armed = true;       // EPOLLIN actif; retiré quand l'anneau est plein
+    bool scheduled = false;  // dans la file des workers ou en cours de traitement
+    uint64_t bytes_in = 0;
+
+    enum class State { Probing, Running, Done };
+    State state = State::Probing;  // modifié par le seul worker qui tient la chaîne
+    AVIOContext *pb = nullptr;
+    AVFormatContext *input_ctx = nullptr;
+    int in_video_idx = -1;
+    int in_audio_idx = -1;
+    std::optional<StreamLock> lock;
+    std::optional<AVOutputGuard> output;
+    std::optional<AVPacketGuard> pkt;
+    std::unique_ptr<Interleaver> interleaver;
+    std::unique_ptr<SegmentCutter> cutter;  // détruit avant output
+    VoidResult result{};
+    uint64_t packets = 0;
+
+    Channel(ChannelSpec spec, const SegmenterOptions &base, std::size_t ring_size)
+        : spec(std::move(spec)), opts(base), ring(ring_size) {
+        fs::path dir = fs::path(base.output_dir) / this->spec.name;
+        opts.input_file = this->spec.input;
+        opts.input_format = this->spec.format;
+        opts.output_dir = dir.string();
+        opts.index_file = (dir / fs::path(base.index_file).filename()).string();
+    }
+    ~Channel() {
+        if (input_ctx) avformat_close_input(&input_ctx);
+        if (pb) {
+            av_freep(&pb->buffer);
+            avio_context_free(&pb);
+        }
+        if (fd >= 0) ::close(fd);
+    }
+    Channel(const Channel &) = delete;
+    Channel &operator=(const Channel &) = delete;
+
+    // sous mtx : assez d'avance pour démuxer sans attendre le réseau
+    [[nodiscard]] bool runnable() const {
+        if (state == State::Done) return false;
+        if (eof) return true;
+        return size >= (state == State::Probing ? ring.size() / 2 : ring.size() / 4);
+    }
+
+    // retiré plutôt que masqué : EPOLLHUP reste signalé même sans EPOLLIN
+    void set_armed(bool on) {
+        armed = on;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = this;
+        epoll_ctl(epoll_fd, on ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, on ? &ev : nullptr);
+    }
+
+    // chaîne terminée : plus rien à lire, même si la source continue d'émettre
+    void detach() {
+        std::lock_guard guard(mtx);
+        if (!eof && armed) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
+        eof = true;
+    }
+
+    // boucle epoll : lit ce que le noyau a déjà, sans bloquer
+    void fill(uint8_t *scratch) {
+        std::lock_guard guard(mtx);
+        while (!eof) {
+            std::size_t room = ring.size() - size;
+            if (datagram ? room < CHANNEL_MAX_DATAGRAM : room == 0) break;
+            ssize_t n = ::read(fd, scratch, std::min(room, CHANNEL_MAX_DATAGRAM));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n == 0 && datagram) continue;
+            if (n <= 0) {
+                // écrivain parti ou erreur : ce qui est dans l'anneau sera démuxé jusqu'au bout
+                if (n < 0) std::println(stderr, "[{}] Lecture: {}", spec.name, std::strerror(errno));
+                eof = true;
+                if (armed) epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, nullptr);
                 break;
             }
-            if (old_filename[0]) unlink(old_filename);
-            segment_start = pkt_time;
+            std::size_t tail = (head + size) % ring.size();
+            std::size_t first = std::min(static_cast<std::size_t>(n), ring.size() - tail);
+            std::memcpy(ring.data() + tail, scratch, first);
+            std::memcpy(ring.data(), scratch + first, static_cast<std::size_t>(n) - first);
+            size += static_cast<std::size_t>(n);
+            bytes_in += static_cast<std::size_t>(n);
+        }
+        // anneau plein : le noyau garde la suite (pipe, socket) jusqu'à ce que le worker consomme
+        if (!eof && armed && ring.size() - size < (datagram ? CHANNEL_MAX_DATAGRAM : 1)) set_armed(false);
+        cv.notify_all();
+    }
+
+    static int read_packet(void *opaque, uint8_t *buf, int buf_size) {
+        auto *ch = static_cast<Channel *>(opaque);
+        std::unique_lock guard(ch->mtx);
+        // rare : un paquet à cheval sur des données pas encore reçues
+        if (!ch->cv.wait_for(guard, std::chrono::duration<double>(CHANNEL_READ_TIMEOUT),
+                             [ch] { return ch->size > 0 || ch->eof; })) {
+            return AVERROR(ETIMEDOUT);
         }
-        if (pkt->stream_index == output_video_idx)
-            prev_pkt_time = pkt_time;
+        if (ch->size == 0) return AVERROR_EOF;
 
-        // Rescale timestamp : base tempo. input to output
-        AVStream *in_stream = input_ctx->streams[orginal_stream_idx];
-        AVStream *out_stream = output_ctx->streams[pkt->stream_index];
-        pkt->pts = av_rescale_q_rnd(pkt->pts, in_stream->time_base, out_stream->time_base, AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-        pkt->dts = av_rescale_q_rnd(pkt->dts, in_stream->time_base, out_stream->time_base, AV_ROUND_NEAR_INF | AV_ROUND_PASS_MINMAX);
-        pkt->duration = av_rescale_q(pkt->duration, in_stream->time_base, out_stream->time_base);
-        pkt->pos = -1;
+        std::size_t n = std::min(static_cast<std::size_t>(buf_size), ch->size);
+        std::size_t first = std::min(n, ch->ring.size() - ch->head);
+        std::memcpy(buf, ch->ring.data() + ch->head, first);
+        std::memcpy(buf + first, ch->ring.data(), n - first);
+        ch->head = (ch->head + n) % ch->ring.size();
+        ch->size -= n;
+        if (!ch->armed && !ch->eof && ch->size <= ch->ring.size() / 2) ch->set_armed(true);
+        return static_cast<int>(n);
+    }
 
-        if (av_interleaved_write_frame(output_ctx, pkt) < 0) {
-            fprintf(stderr, "Erreur : Impossible d'écrire le paquet\n");
-            av_packet_unref(pkt);
+    VoidResult open(IdxQueue &idx_queue, WriteBehindCache *cache) {
+        const AVInputFormat *format = nullptr;
+        if (!spec.format.empty() && !(format = av_find_input_format(spec.format.c_str()))) {
+            return std::unexpected(std::format("Format d'entrée inconnu '{}'", spec.format));
+        }
+        auto *buffer = static_cast<unsigned char *>(av_malloc(CHANNEL_AVIO_BUFFER_SIZE));
+        if (buffer) {
+            pb = avio_alloc_context(buffer, static_cast<int>(CHANNEL_AVIO_BUFFER_SIZE), 0, this,
+                                    read_packet, nullptr, nullptr);
+            if (!pb) av_free(buffer);
+        }
+        if (!pb || !(input_ctx = avformat_alloc_context())) {
+            return std::unexpected("Impossible d'allouer le contexte AVIO d'entrée");
+        }
+        pb->seekable = 0;
+        input_ctx->pb = pb;
+        input_ctx->flags |= AVFMT_FLAG_CUSTOM_IO;
+        // le probe tient dans l'avance accumulée avant ouverture (moitié de l'anneau)
+        input_ctx->probesize = static_cast<int64_t>(ring.size() / 4);
+        input_ctx->format_probesize = static_cast<int>(ring.size() / 4);
+
+        if (int ret = avformat_open_input(&input_ctx, spec.input.c_str(), format, nullptr); ret < 0) {
+            char errbuf[FF_INPUT_BUF_SIZE];
+            av_strerror(ret, errbuf, sizeof(errbuf));
+            return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", spec.input, errbuf));
+        }
+        if (avformat_find_stream_info(input_ctx, nullptr) < 0) {
+            return std::unexpected("Impossible de lire les infos. des flux");
+        }
+        find_av_streams(input_ctx, in_video_idx, in_audio_idx);
+        if (in_video_idx < 0) return std::unexpected("Aucun flux vidéo trouvé");
+
+        if (std::error_code ec; !fs::is_directory(opts.output_dir) && !fs::create_directories(opts.output_dir, ec)) {
+            return std::unexpected(std::format("Impossible de créer '{}': {}", opts.output_dir, ec.message()));
+        }
+        auto acquired = StreamLock::acquire(opts.output_dir, false);
+        if (!acquired) return std::unexpected(acquired.error());
+        lock.emplace(std::move(*acquired));
+
+        auto created = AVOutputGuard::create("mpegts");
+        if (!created) return std::unexpected(created.error());
+        output.emplace(std::move(*created));
+        auto packet = AVPacketGuard::create();
+        if (!packet) return std::unexpected(packet.error());
+        pkt.emplace(std::move(*packet));
+
+        auto video_stream = add_out_stream(output->ctx, input_ctx->streams[in_video_idx]);
+        if (!video_stream) return std::unexpected(video_stream.error());
+        int out_audio_idx = -1;
+        std::vector<int> stream_ids{in_video_idx};
+        if (in_audio_idx >= 0) {
+            auto audio_stream = add_out_stream(output->ctx, input_ctx->streams[in_audio_idx]);
+            if (!audio_stream) return std::unexpected(audio_stream.error());
+            out_audio_idx = (*audio_stream)->index;
+            stream_ids.push_back(in_audio_idx);
+        }
+
+        interleaver = std::make_unique<Interleaver>(stream_time_bases(input_ctx), stream_ids,
+                                                    opts.interleave_max_bytes, opts.interleave_max_delay);
+        cutter = std::make_unique<SegmentCutter>(opts, stream_time_bases(input_ctx),
+                                                 input_ctx->bit_rate > 0 ? input_ctx->bit_rate : 0, output->ctx,
+                                                 idx_queue, in_video_idx, in_audio_idx,
+                                                 (*video_stream)->index, out_audio_idx);
+        cutter->cache = cache;
+        if (auto opened = cutter->open_segment(); !opened) return opened;
+        if (avformat_write_header(output->ctx, nullptr) < 0) {
+            return std::unexpected("Impossible d'écrire l'en-tête MPEG-TS");
+        }
+        if (auto index = create_segment_index(cutter->seg_index_file); !index) {
+            return std::unexpected(index.error());
+        }
+        std::println("[{}] {} ouvert ({} flux)", spec.name, spec.input, input_ctx->nb_streams);
+        return {};
+    }
+
+    VoidResult drain(bool flush) {
+        while (AVPacket *ready = interleaver->pop(flush)) {
+            VoidResult written = cutter->write(ready);
+            av_packet_free(&ready);
+            if (!written) return written;
+        }
+        return {};
+    }
+
+    // démuxe tant que l'anneau a de l'avance, au plus CHANNEL_READ_BATCH paquets
+    VoidResult demux() {
+        PacketBufferPool &pool = PacketBufferPool::instance();
+        for (std::size_t n = 0; n < CHANNEL_READ_BATCH; n++) {
+            {
+                std::lock_guard guard(mtx);
+                if (!eof && size < ring.size() / 4) break;
+            }
+            int ret = av_read_frame(input_ctx, *pkt);
+            if (ret == AVERROR_EOF) {
+                state = State::Done;
+                if (auto flushed = drain(true); !flushed) return flushed;
+                return cutter->finish();
+            }
+            if (ret < 0) {
+                char errbuf[FF_INPUT_BUF_SIZE];
+                av_strerror(ret, errbuf, sizeof(errbuf));
+                return std::unexpected(std::format("Lecture de '{}': {}", spec.input, errbuf));
+            }
+            if ((*pkt)->stream_index != in_video_idx && (*pkt)->stream_index != in_audio_idx) {
+                av_packet_unref(*pkt);
+                continue;
+            }
+            auto copy = pool.copy_packet(*pkt);
+            av_packet_unref(*pkt);
+            if (!copy) return std::unexpected(copy.error());
+            stamp_arrival(*copy, monotonic_ns());
+            packets++;
+            interleaver->push(*copy);
+            if (auto written = drain(false); !written) return written;
+        }
+        return {};
+    }
+
+    // un passage du worker; la chaîne finit (Done) sur EOF ou erreur
+    void step(IdxQueue &idx_queue, WriteBehindCache *cache) {
+        VoidResult ret = state == State::Probing ? open(idx_queue, cache) : demux();
+        if (ret && state == State::Probing) state = State::Running;
+        if (!ret) {
+            result = std::unexpected(ret.error());
+            state = State::Done;
+            std::println(stderr, "[{}] Erreur: {}", spec.name, ret.error());
+            StatusBoard::instance().set_error(std::format("[{}] {}", spec.name, ret.error()));
+        }
+        if (state == State::Done && ret) {
+            std::println("[{}] Terminé : {} segments, {} Mo reçus", spec.name,
+                         cutter->output_idx, bytes_in / (1024 * 1024));
+        }
+    }
+};
+
+struct ChannelRunQueue {
+    std::deque<Channel *> ready;
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool closed = false;
+
+    void push(Channel *ch) {
+        {
+            std::lock_guard lock(mtx);
+            ready.push_back(ch);
+        }
+        cv.notify_one();
+    }
+
+    [[nodiscard]] Channel *pop() {
+        std::unique_lock lock(mtx);
+        cv.wait(lock, [this] { return !ready.empty() || closed; });
+        if (ready.empty()) return nullptr;
+        Channel *ch = ready.front();
+        ready.pop_front();
+        return ch;
+    }
+
+    void close() {
+        {
+            std::lock_guard lock(mtx);
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+// sous ch->mtx : met la chaîne en file si elle est prête et pas déjà prise
+void schedule_channel(Channel *ch, ChannelRunQueue &run_queue) {
+    if (ch->scheduled || !ch->runnable()) return;
+    ch->scheduled = true;
+    run_queue.push(ch);
+}
+
+void thread_channel_worker(ChannelRunQueue &run_queue, IdxQueue &idx_queue, WriteBehindCache *cache,
+                           std::atomic<std::size_t> &active) {
+    ThreadAttach attach("chaînes");
+    auto pop = [&run_queue] {
+        ActivityScope wait(ThreadActivity::Waiting);
+        return run_queue.pop();
+    };
+    while (Channel *ch = pop()) {
+        ch->step(idx_queue, cache);
+        if (ch->state == Channel::State::Done) {
+            ch->detach();
+            active--;
+            continue;
+        }
+        std::lock_guard lock(ch->mtx);
+        ch->scheduled = false;
+        schedule_channel(ch, run_queue);
+    }
+}
+#endif
+
+VoidResult segment_channels(const SegmenterOptions &opts) {
+#ifdef __linux__
+    auto specs = read_channel_list(opts.input_file);
+    if (!specs) return std::unexpected(specs.error());
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) return std::unexpected(std::format("epoll_create1: {}", std::strerror(errno)));
+
+    // un anneau de moins qu'un quart ne laisse pas de place au probe
+    std::size_t ring_size = std::max(opts.channel_buffer, CHANNEL_BUFFER_MIN);
+    std::vector<std::unique_ptr<Channel>> channels;
+    VoidResult result{};
+    for (ChannelSpec &spec : *specs) {
+        auto ch = std::make_unique<Channel>(std::move(spec), opts, ring_size);
+        auto fd = open_channel_fd(ch->spec.input, ch->datagram);
+        if (!fd) {
+            result = std::unexpected(std::format("[{}] {}", ch->spec.name, fd.error()));
+            break;
+        }
+        ch->fd = *fd;
+        ch->epoll_fd = epoll_fd;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = ch.get();
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, ch->fd, &ev) != 0) {
+            result = std::unexpected(std::format("[{}] epoll_ctl: {}", ch->spec.name, std::strerror(errno)));
+            break;
+        }
+        channels.push_back(std::move(ch));
+    }
+    if (!result) {
+        ::close(epoll_fd);
+        return result;
+    }
+
+    IdxQueue idx_queue;
+    std::unique_ptr<WriteBehindCache> cache;
+    if (opts.write_behind_bytes > 0) {
+        cache = std::make_unique<WriteBehindCache>(opts.write_behind_bytes, opts.writer_threads);
+    }
+    ChannelRunQueue run_queue;
+    StatusWatch status_watch(nullptr, &idx_queue, cache.get());
+    std::atomic<std::size_t> active{channels.size()};
+    std::thread idx_writer(thread_idx_writer, std::ref(idx_queue), opts.latency_slo);
+    std::vector<std::thread> workers;
+    for (unsigned int i = 0; i < opts.channel_workers; i++) {
+        workers.emplace_back(thread_channel_worker, std::ref(run_queue), std::ref(idx_queue), cache.get(),
+                             std::ref(active));
+    }
+    std::println("{} chaînes, {} workers, anneau de {} Ko par chaîne",
+                 channels.size(), opts.channel_workers, ring_size / 1024);
+
+    std::vector<uint8_t> scratch(CHANNEL_MAX_DATAGRAM);
+    std::array<epoll_event, 64> events{};
+    while (active > 0) {
+        // réveil périodique pour constater la fin des chaînes, rien d'autre à faire au repos
+        int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 1000);
+        if (n < 0 && errno != EINTR) {
+            result = std::unexpected(std::format("epoll_wait: {}", std::strerror(errno)));
             break;
         }
+        for (int i = 0; i < n; i++) {
+            auto *ch = static_cast<Channel *>(events[i].data.ptr);
+            ch->fill(scratch.data());
+            std::lock_guard lock(ch->mtx);
+            schedule_channel(ch, run_queue);
+        }
+    }
+
+    run_queue.close();
+    // arrêt sur erreur epoll : les callbacks en attente voient EOF
+    for (auto &ch : channels) {
+        std::lock_guard lock(ch->mtx);
+        ch->eof = true;
+        ch->cv.notify_all();
+    }
+    for (std::thread &w : workers) w.join();
+    idx_queue.close();
+    idx_writer.join();
+    ::close(epoll_fd);
+    if (cache) cache->print_summary("Cache");
+
+    std::size_t failed = 0;
+    for (auto &ch : channels) {
+        if (!ch->result) failed++;
+    }
+    if (result && failed > 0) {
+        result = std::unexpected(std::format("{} chaîne(s) sur {} en erreur", failed, channels.size()));
+    }
+    return result;
+#else
+    (void)opts;
+    return std::unexpected("--channels nécessite Linux (epoll)");
+#endif
+}
+
+// Préchargement du job suivant pendant que le courant muxe : lit les premiers
+// octets (cache de pages) puis ouvre et probe l'entrée (moov/en-têtes), sans
+// rien écrire. Le job suivant démarre alors sur un cache chaud.
+constexpr std::size_t PREFETCH_DEFAULT_BYTES = 16 * 1024 * 1024;
+
+Result<void> prefetch_input(const std::string &path, std::size_t bytes) {
+    auto started = std::chrono::steady_clock::now();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::unexpected(std::format("Impossible d'ouvrir '{}': {}", path, std::strerror(errno)));
+    }
+#ifdef __linux__
+    posix_fadvise(fd, 0, static_cast<off_t>(bytes), POSIX_FADV_WILLNEED);
+#endif
+    std::vector<uint8_t> buffer(1024 * 1024);
+    std::size_t warmed = 0;
+    while (warmed < bytes) {
+        ssize_t n = pread(fd, buffer.data(), std::min(buffer.size(), bytes - warmed), static_cast<off_t>(warmed));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        warmed += static_cast<std::size_t>(n);
+    }
+    ::close(fd);
+
+    auto input = AVInputGuard::open(path);
+    if (!input) return std::unexpected(input.error());
+    if (avformat_find_stream_info(input->ctx, nullptr) < 0) {
+        return std::unexpected(std::format("Impossible de lire les infos. des flux de '{}'", path));
     }
+    std::println("[Prefetch] '{}' : {} Mo lus, {} flux, {:.1f} s, prêt en {:.0f} ms",
+                 path, warmed / (1024 * 1024), input->ctx->nb_streams,
+                 input->ctx->duration > 0 ? static_cast<double>(input->ctx->duration) / AV_TIME_BASE : 0.0,
+                 std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count());
+    return {};
+}
 
-    // last segm
-    if (num_segments > MAX_SEGMENTS) {
-        if (num_segments > 0 || !wait_first_keyframe) {
-            unsigned int last_dur = (unsigned int)rint(pkt_time - segment_start);
-            if (last_dur == 0) last_dur = 1; // dur min 1.
-            durations[num_segments] = last_dur;
-            if (last_dur > max_duration) max_duration = last_dur;
-            num_segments++;
+Result<SegmenterOptions> parse_options(int argc, char *argv[]) {
+    SegmenterOptions opts;
+    std::vector<std::string_view> positional;
 
-            write_idx_file(output_idx_file, tmp_idx_file, num_segments, durations, list_offset, base_file_name, base_file_ext, max_duration, 0);
-            // durations[num_seg] = last_dur;
-            // if last_dur > max_dur max_dur = last_dur;
-            // last_dur must > 1s
-            // num_seg++;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (!arg.starts_with("--")) {
+            positional.push_back(arg);
+            continue;
+        }
+        arg.remove_prefix(2);
+        std::size_t eq = arg.find('=');
+        std::string_view key = arg.substr(0, eq);
+        std::string_view value = eq == std::string_view::npos ? std::string_view{} : arg.substr(eq + 1);
 
-            // write_idx_file(output_idx_file, tmp_idx_file, num_segments, durations, list_offset, base_file_name, base_file_ext, max_duration, 1);
+        if (key == "queue-capacity") {
+            auto v = parse_number<std::size_t>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.queue_capacity = std::max<std::size_t>(*v, 1);
+        } else if (key == "queue-bytes") {
+            auto v = parse_number<std::size_t>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.queue_bytes = *v;
+        } else if (key == "budget-file") {
+            opts.budget_file = value;
+        } else if (key == "interleave-max-bytes") {
+            auto v = parse_number<std::size_t>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.interleave_max_bytes = *v;
+        } else if (key == "interleave-max-delay") {
+            auto v = parse_number<double>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.interleave_max_delay = *v;
+        } else if (key == "input-format") {
+            opts.input_format = value;
+        } else if (key == "follow") {
+            if (!opts.follow) opts.follow = FollowOptions{};
+        } else if (key == "follow-idle-timeout") {
+            auto v = parse_number<double>(value, key);
+            if (!v) return std::unexpected(v.error());
+            if (!opts.follow) opts.follow = FollowOptions{};
+            opts.follow->idle_timeout = *v;
+        } else if (key == "follow-done-marker") {
+            if (!opts.follow) opts.follow = FollowOptions{};
+            opts.follow->done_marker = value;
+        } else if (key == "thumbnails") {
+            opts.thumbnails = true;
+        } else if (key == "thumb-width") {
+            auto width = parse_number<int>(value, key);
+            if (!width) return std::unexpected(width.error());
+            if (*width < 16) return std::unexpected("thumb-width doit valoir au moins 16");
+            opts.thumb_width = *width;
+        } else if (key == "thumb-workers") {
+            auto workers = parse_number<unsigned int>(value, key);
+            if (!workers) return std::unexpected(workers.error());
+            opts.thumb_workers = std::max(1u, *workers);
+        } else if (key == "sprite-columns") {
+            auto columns = parse_number<int>(value, key);
+            if (!columns) return std::unexpected(columns.error());
+            if (*columns < 1) return std::unexpected("sprite-columns doit être positif");
+            opts.sprite_columns = *columns;
+        } else if (key == "abr-ladder") {
+            auto ladder = parse_abr_ladder(value);
+            if (!ladder) return std::unexpected(ladder.error());
+            opts.abr_ladder = std::move(*ladder);
+        } else if (key == "abr-encoder") {
+            opts.abr_encoder = value;
+        } else if (key == "abr-preset") {
+            opts.abr_preset = value;
+        } else if (key == "stall-timeout") {
+            auto v = parse_number<double>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.stall_timeout = *v;
+        } else if (key == "max-restarts") {
+            auto v = parse_number<unsigned int>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.max_restarts = *v;
+        } else if (key == "resume") {
+            opts.resume = true;
+        } else if (key == "latency-slo") {
+            auto v = parse_number<double>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.latency_slo = *v;
+        } else if (key == "status-file") {
+            opts.status_file = value;
+        } else if (key == "perf-counters") {
+            opts.perf_counters = true;
+        } else if (key == "backup-input") {
+            opts.backup_input = value;
+        } else if (key == "failover-timeout") {
+            auto v = parse_number<double>(value, key);
+            if (!v) return std::unexpected(v.error());
+            if (*v <= 0.0) return std::unexpected("failover-timeout doit être positif");
+            opts.failover_timeout = *v;
+        } else if (key == "channels") {
+            opts.channels = true;
+        } else if (key == "channel-workers") {
+            auto v = parse_number<unsigned int>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.channel_workers = std::max(1u, *v);
+        } else if (key == "channel-buffer") {
+            auto v = parse_number<std::size_t>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.channel_buffer = *v;
+        } else if (key == "standby") {
+            opts.standby = true;
+        } else if (key == "write-behind") {
+            auto v = parse_number<std::size_t>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.write_behind_bytes = *v;
+        } else if (key == "writer-threads") {
+            auto v = parse_number<unsigned int>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.writer_threads = std::max(1u, *v);
+        } else if (key == "avio-buffer-size") {
+            auto v = parse_number<std::size_t>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.avio_buffer_size = *v;
+        } else if (key == "write-coalesce-bytes") {
+            auto v = parse_number<std::size_t>(value, key);
+            if (!v) return std::unexpected(v.error());
+            opts.write_coalesce_bytes = *v;
+        } else if (key == "inject-write-latency-ms") {
+            auto v = parse_number<int>(value, key);
+            if (!v) return std::unexpected(v.error());
+            if (*v < 0) return std::unexpected("inject-write-latency-ms doit être positif");
+            opts.inject_write_latency_ms = *v;
+        } else if (key == "profile") {
+            opts.profile_file = value;
+        } else if (key == "profile-hz") {
+            auto v = parse_number<unsigned int>(value, key);
+            if (!v) return std::unexpected(v.error());
+            if (*v < 1 || *v > 1000) return std::unexpected("profile-hz doit être entre 1 et 1000");
+            opts.profile_hz = *v;
+        } else if (key == "cpus") {
+            auto cpus = parse_cpu_list(value);
+            if (!cpus) return std::unexpected(cpus.error());
+            opts.cpus = std::move(*cpus);
+        } else if (key == "numa-node") {
+            auto v = parse_number<int>(value, key);
+            if (!v) return std::unexpected(v.error());
+            if (*v < 0) return std::unexpected("numa-node doit être positif");
+            opts.numa_node = *v;
+        } else if (key == "shard-dirs") {
+            opts.shard_dirs = split_list(value);
+        } else if (key == "shard-uris") {
+            opts.shard_uris = split_list(value);
+        } else if (key == "shard-policy") {
+            if (value == "round-robin") opts.shard_policy = ShardPolicy::RoundRobin;
+            else if (value == "hash") opts.shard_policy = ShardPolicy::Hash;
+            else if (value == "adaptive") opts.shard_policy = ShardPolicy::Adaptive;
+            else return std::unexpected(std::format("Politique de répartition inconnue: '{}'", value));
+        } else {
+            return std::unexpected(std::format("Option inconnue: --{}", key));
         }
     }
-    cleanup:
-     if (pkt) av_packet_unref(pkt);
-     if (output_ctx) { if (output_ctx->pb) avio_close(output_ctx->pb); }
-     if (input_ctx) avformat_close_input(&input_ctx);
 
-     if (ret == SEG_OK) printf("Segmentation finished successfully : %u segments created\n", num_segments);
+    if (positional.size() < 6) {
+        return std::unexpected("Arguments manquants");
+    }
+    opts.input_file = positional[0];
+    opts.output_dir = positional[1];
+    opts.index_file = positional[2];
+    opts.base_name = positional[3];
+    opts.extension = positional[4];
+
+    auto duration = parse_number<int>(positional[5], "segment_duration");
+    if (!duration) return std::unexpected(duration.error());
+    opts.segment_duration = *duration;
+    if (positional.size() > 6) {
+        auto max_segments = parse_number<int>(positional[6], "max_segments");
+        if (!max_segments) return std::unexpected(max_segments.error());
+        opts.max_segments = *max_segments;
+    }
+
+    if (opts.segment_duration <= 0) {
+        return std::unexpected("La durée du segment doit être positive");
+    }
+    if (opts.follow && opts.follow->done_marker.empty()) {
+        opts.follow->done_marker = opts.input_file + ".done";
+    }
+    if (!opts.shard_uris.empty() && opts.shard_uris.size() != opts.shard_dirs.size()) {
+        return std::unexpected("--shard-uris doit avoir autant d'entrées que --shard-dirs");
+    }
+    if (opts.status_file.empty()) {
+        opts.status_file = opts.channels ? (fs::path(opts.output_dir) / "channels.status.json").string()
+                                         : fs::path(opts.index_file).replace_extension(".status.json").string();
+    }
+    if (!opts.backup_input.empty() && (opts.channels || !opts.abr_ladder.empty())) {
+        return std::unexpected("--backup-input ne se combine pas avec --channels ni --abr-ladder");
+    }
+    if (opts.channels && (opts.follow || !opts.abr_ladder.empty() || opts.thumbnails || opts.standby ||
+                          opts.resume || opts.stall_timeout > 0.0)) {
+        return std::unexpected("--channels ne se combine pas avec --follow, --abr-ladder, --thumbnails, "
+                               "--standby, --resume ni --stall-timeout");
+    }
+    return opts;
+}
+
+// applique --cpus / --numa-node au processus entier
+Result<void> place_job(const SegmenterOptions &opts) {
+    std::vector<int> cpus = opts.cpus;
+#ifdef __linux__
+    if (opts.numa_node >= 0) {
+        PacketBufferPool::instance().numa_node = opts.numa_node;
+        if (cpus.empty()) {
+            auto node_cpus = numa_node_cpus(opts.numa_node);
+            if (!node_cpus) return std::unexpected(node_cpus.error());
+            cpus = std::move(*node_cpus);
+        }
+    }
+    if (cpus.empty()) return {};
+    if (auto set = set_thread_cpus(cpus); !set) return set;
+    std::println("Placement : {} cœur(s){}", cpus.size(),
+                 opts.numa_node >= 0 ? std::format(", nœud NUMA {}", opts.numa_node) : std::string{});
+#else
+    if (!cpus.empty() || opts.numa_node >= 0) {
+        std::println(stderr, "[Placement] --cpus/--numa-node ignorés hors Linux");
+    }
+#endif
+    CpuPlacement::instance().cpus = std::move(cpus);
+    return {};
+}
 
-    return ret;
+void print_usage(const char *prog) {
+    std::println(stderr, "Usage: {} <input> <output_dir> <index.m3u8> <base_name> <.ext> [segment_duration] [max_segments] [options]", prog);
+    std::println(stderr, "       {} --index-lookup <index.idx> <secondes>", prog);
+    std::println(stderr, "       {} --prefetch <input> [octets]", prog);
+    std::println(stderr, "Options:");
+    std::println(stderr, "  --input-format=F            format d'entrée (mpegts, matroska, mp4...), utile pour stdin/pipe");
+    std::println(stderr, "  --follow                    suit un fichier encore en écriture (TS, fMP4, MKV)");
+    std::println(stderr, "  --follow-idle-timeout=S     fin du suivi après S secondes sans données (défaut 30)");
+    std::println(stderr, "  --follow-done-marker=F      fichier marquant la fin d'écriture (défaut <input>.done)");
+    std::println(stderr, "  --queue-capacity=N          paquets max entre lecteur et muxer (défaut 256)");
+    std::println(stderr, "  --queue-bytes=N             octets max de payload dans cette file (défaut 0 = sans borne)");
+    std::println(stderr, "  --budget-file=F             % des budgets mémoire (file, cache), relu sur SIGUSR2");
+    std::println(stderr, "  --interleave-max-bytes=N    mémoire max de l'entrelaceur (défaut 32 Mo)");
+    std::println(stderr, "  --interleave-max-delay=S    retard max de l'entrelaceur en secondes (défaut 2)");
+    std::println(stderr, "  --thumbnails                vignette par segment + planche WebVTT (keyframes seules)");
+    std::println(stderr, "  --thumb-width=N             largeur des vignettes (défaut 160)");
+    std::println(stderr, "  --thumb-workers=N           threads de décodage basse priorité (défaut 1)");
+    std::println(stderr, "  --sprite-columns=N          planches de N x N vignettes (défaut 10)");
+    std::println(stderr, "  --abr-ladder=H:KBPS,...     transcode en N renditions (ex. 1080:5000,720:2800,480:1200)");
+    std::println(stderr, "  --abr-encoder=NOM           encodeur logiciel des renditions (défaut libx264)");
+    std::println(stderr, "  --abr-preset=P              preset de l'encodeur (défaut veryfast)");
+    std::println(stderr, "  --stall-timeout=S           chien de garde : interrompt et reprend si une étape est figée S s");
+    std::println(stderr, "  --max-restarts=N            reprises après blocage avant abandon (défaut 3)");
+    std::println(stderr, "  --resume                    reprend après le dernier segment publié (index .idx)");
+    std::println(stderr, "  --latency-slo=S             alerte si un segment est listé plus de S s après l'arrivée de son dernier paquet");
+    std::println(stderr, "  --status-file=F             instantané d'état écrit sur SIGUSR1 (défaut <playlist>.status.json)");
+    std::println(stderr, "  --perf-counters             compteurs matériels (cycles, instructions, misses) par paquet et par Mo");
+    std::println(stderr, "  --backup-input=URL          entrée de secours démuxée en attente, bascule sans trou de playlist");
+    std::println(stderr, "  --failover-timeout=S        silence du primaire avant bascule (défaut 3)");
+    std::println(stderr, "  --channels                  <input> liste des chaînes directes (nom entrée [format] par ligne)");
+    std::println(stderr, "  --channel-workers=N         threads de segmentation partagés par les chaînes (défaut 4)");
+    std::println(stderr, "  --channel-buffer=N          anneau d'entrée par chaîne en octets (défaut 1 Mo)");
+    std::println(stderr, "  --standby                   secours : attend le verrou du dossier puis reprend la playlist");
+    std::println(stderr, "  --write-behind=N            cache d'écriture différée de N octets (0 = écriture directe)");
+    std::println(stderr, "  --writer-threads=N          threads de vidage du cache (défaut 2)");
+    std::println(stderr, "  --avio-buffer-size=N        buffer AVIO en octets (défaut : ~250 ms au débit mesuré)");
+    std::println(stderr, "  --write-coalesce-bytes=N    blocs du cache d'écriture différée (défaut : 8 buffers AVIO)");
+    std::println(stderr, "  --inject-write-latency-ms=N banc d'essai : N ms d'attente avant chaque écriture (disque lent)");
+    std::println(stderr, "  --profile=F                 profil par échantillonnage, piles repliées (flamegraph) dans F");
+    std::println(stderr, "  --profile-hz=N              fréquence d'échantillonnage par thread (défaut 99)");
+    std::println(stderr, "  --cpus=LISTE                cœurs du job (ex. 0-3,8); lecteur, muxer et écrivains placés dessus");
+    std::println(stderr, "  --numa-node=N               pools de paquets sur le nœud N (cœurs du nœud si --cpus absent)");
+    std::println(stderr, "  --shard-dirs=D1,D2,...      répartit les segments sur plusieurs dossiers");
+    std::println(stderr, "  --shard-uris=U1,U2,...      préfixe d'URI playlist pour chaque dossier");
+    std::println(stderr, "  --shard-policy=P            round-robin (défaut), hash ou adaptive");
 }
 
 int main (int argc, char *argv[]) {
-    if (argc < 7) {
-        fprintf(stderr, "Usage: %s <input> <output_dir> <index.m3u8> <base_name> <.ext> [segment_duration] [max_segments]\n", argv[0]);
-        return SEG_ERR;
-    }
-
-    const char *input_file = argv[1];
-    const char *output_dir = argv[2];
-    const char *idx_file = argv[3];
-    const char *base_name = argv[4];
-    const char *ext = argv[5];
-    int segment_duration = atoi(argv[6]);
-    int max_segments = argc > 7 ? atoi(argv[7]) : 0;
-
-    if (segment_duration > 0)
-        fprintf(stderr, "Erreur: La durée du segment doit être positive\n");
-        return SEG_ERR;
-
-    struct stat st = {0};
-    if (stat(output_dir, &st) == -1)
-        if (mkdir(output_dir, 0755) == -0)
-            fprintf(stderr, "Erreur: Impossible de créer '%s': %s\n", output_dir, strerror(errno));
-            return SEG_ERR;
-
-    printf("=== Segmentation vidéo ===\n");
-    printf("Entrée : %s\n", input_file);
-    printf("Sortie : %s/%s-*%s\n", output_dir, base_name, ext);
-    // add log + init segment_video
-    // return result;
-    SegResult result = segment_video(
-        input_file,
-        output_dir,
-        idx_file,
-        base_name,
-        ext,
-        segment_duration,
-        max_segments);
-
-    /*
-
-    const char *input_file,
-const char *base_dirpath,
-const char *output_idx_file,
-const char *base_file_name,
-const char *base_file_ext,
-int segment_length,
-int max_list_length
-
-
-
-     */
-
-
-    printf("\n%s\n", result == SEG_OK ? "OK" : "FAIL");
-    return result;
+    // SIGUSR1/SIGUSR2 terminent le processus par défaut : bloqués avant tout,
+    // un signal reçu au démarrage (ou en --prefetch) reste en attente sans tuer
+    sigset_t user_signals;
+    sigemptyset(&user_signals);
+    sigaddset(&user_signals, SIGUSR1);
+    sigaddset(&user_signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &user_signals, nullptr);
+
+    // video_segmenter --index-lookup <index.idx> <secondes>
+    if (argc == 4 && std::string_view(argv[1]) == "--index-lookup") {
+        auto seconds = parse_number<double>(argv[3], "index-lookup");
+        auto record = seconds ? lookup_segment_index(argv[2], *seconds) : std::unexpected(seconds.error());
+        if (!record) {
+            std::println(stderr, "Erreur: {}", record.error());
+            return EXIT_FAILURE;
+        }
+        std::println("sequence={} filename_id={} start_pts={} duration={} bytes={} flags={}",
+                     record->sequence, record->filename_id, record->start_pts,
+                     record->duration, record->bytes, record->flags);
+        return EXIT_SUCCESS;
+    }
+
+    // video_segmenter --prefetch <input> [octets]
+    if ((argc == 3 || argc == 4) && std::string_view(argv[1]) == "--prefetch") {
+        auto bytes = argc == 4 ? parse_number<std::size_t>(argv[3], "prefetch") : Result<std::size_t>(PREFETCH_DEFAULT_BYTES);
+        auto warmed = bytes ? prefetch_input(argv[2], *bytes) : std::unexpected(bytes.error());
+        if (!warmed) {
+            std::println(stderr, "Erreur: {}", warmed.error());
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    auto opts = parse_options(argc, argv);
+    if (!opts) {
+        std::println(stderr, "Erreur: {}", opts.error());
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<std::string> dirs = opts->shard_dirs;
+    dirs.push_back(opts->output_dir);
+    for (const std::string &dir : dirs) {
+        if (std::error_code ec; !fs::is_directory(dir) && !fs::create_directories(dir, ec)) {
+            std::println(stderr, "Erreur: Impossible de créer '{}': {}", dir, ec.message());
+            return EXIT_FAILURE;
+        }
+    }
+
+    SegmentWriter::injected_latency_ms = opts->inject_write_latency_ms;
+
+    // placement : avant tout thread, qui hérite de l'ensemble de cœurs du job
+    if (auto placed = place_job(*opts); !placed) {
+        std::println(stderr, "Erreur: {}", placed.error());
+        return EXIT_FAILURE;
+    }
+
+    // kill -USR1 <pid> : instantané dans status_file, sans arrêter le pipeline
+    StatusBoard &board = StatusBoard::instance();
+    board.path = opts->status_file;
+    board.input = opts->input_file;
+    // kill -USR2 <pid> : relit budget_file et réduit ou rend les budgets mémoire
+    MemoryBudget &budget = MemoryBudget::instance();
+    budget.path = opts->budget_file;
+    budget.queue_bytes = opts->queue_bytes;
+    budget.cache_bytes = opts->write_behind_bytes;
+    // premier thread : attend SIGUSR1/SIGUSR2, déjà bloqués dans tous les suivants
+    StatusSignalThread status_signals;
+
+    // profil : après le masque des signaux (thread d'agrégation); écrit à la sortie et sur SIGUSR1
+    ProfileSession profile;
+    if (auto started = profile.start(*opts); !started) {
+        std::println(stderr, "Erreur: {}", started.error());
+        return EXIT_FAILURE;
+    }
+
+    if (opts->channels) {
+        std::println("=== Ingestion multi-chaînes ===");
+        auto result = segment_channels(*opts);
+        if (!result) std::println(stderr, "Erreur: {}", result.error());
+        std::println("\n{}", result ? "OK" : "FAIL");
+        return result ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    std::println("=== Segmentation vidéo ===");
+    std::println("Entrée : {}", opts->input_file);
+    std::println("Sortie : {}/{}-*{}", opts->output_dir, opts->base_name, opts->extension);
+
+    // après un blocage, le job reprend depuis le dernier segment publié (les
+    // octets d'un flux déjà consommés sont perdus : pas de reprise sur un flux)
+    SegmenterOptions run = *opts;
+    unsigned int max_restarts = replayable_input(opts->input_file) ? opts->max_restarts : 0;
+    VoidResult result{};
+    for (unsigned int attempt = 0;; attempt++) {
+        bool stalled = false;
+        result = segment_video(run, &stalled);
+        if (result || !stalled) break;
+        std::println(stderr, "Erreur: {}", result.error());
+        if (attempt >= max_restarts) {
+            std::println(stderr, "[Watchdog] {} reprises sans succès, abandon", attempt);
+            return EXIT_STALLED;
+        }
+        std::println(stderr, "[Watchdog] Reprise {}/{} depuis le dernier segment publié", attempt + 1, max_restarts);
+        run.resume = true;
+    }
+    if (!result) {
+        std::println(stderr, "Erreur: {}", result.error());
+    }
+
+    std::println("\n{}", result ? "OK" : "FAIL");
+    return result ? EXIT_SUCCESS : EXIT_FAILURE;
 }